@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <ctype.h>
 
 #include "libcurse.h"
 
@@ -22,9 +23,41 @@ int help(void) {
        "       +                enable curse <cursename>\n"
        "       -                disable curse <cursename>\n"
        "\n"
-       "     <pid>+             curse <pid> with <cursename>\n"
+       "     <pid>+ [<param>...] curse <pid> with <cursename>, or change\n"
+       "                        the parameters of an already cursed <pid>\n"
        "     <pid>-             lift curse <cursename> from pid\n"
        "     <pid>?             show <cursename> status for pid\n"
+       "     <pid>=             show curse parameters of pid\n"
+       "\n"
+       " Parameters                       Description\n"
+       "----------------        ---------------------\n"
+       "  wavelength=<bytes>    nocache: bytes moved between two evictions\n"
+       "  mode=dropbehind       nocache: evict the pages behind the reader\n"
+       "  mode=wholefile        nocache: evict every page of touched files\n"
+       "  async                 nocache: evict from a kernel workqueue\n"
+       "  sync                  nocache: evict within read()/write()\n"
+       "  adaptive              nocache: scale wavelength with free memory\n"
+       "  fixed                 nocache: keep wavelength fixed\n"
+       "  writebehind           nocache: evict written pages once written back\n"
+       "  nowritebehind         nocache: leave pages still dirty to reclaim\n"
+       "  demote                nocache: leave pages to reclaim instead of evicting\n"
+       "  evict                 nocache: evict pages right away\n"
+       "  owned                 nocache: only evict pages the process brought in\n"
+       "  all                   nocache: also evict pages that were already cached\n"
+       "  streams               nocache: only evict files read or written sequentially\n"
+       "  nostreams             nocache: evict every file moved through\n"
+       "  budget=<pages>        nocache: pages evicted per checkpoint, 0 for no limit\n"
+       "  backlog=<n>           nocache: async evictions in flight\n"
+       "  period=<ms>           nocache: also evict every <ms> while doing I/O, 0 for never\n"
+       "  faults=<pages>        nocache: mmap faults between two evictions\n"
+       "  dirty=<pages>         dirtylimit: pages written before waiting for writeback\n"
+       "  reckless=async        recklessness: fsync starts writeback, does not wait\n"
+       "  reckless=noop         recklessness: fsync does nothing\n"
+       "  quota=<pages>         cachequota: page cache the process may keep\n"
+       "  bps=<bytes>           throttle: bytes per second, 0 for no limit\n"
+       "  iops=<n>              throttle: reads and writes per second, 0 for no limit\n"
+       "  anon                  stink: anonymous memory stinks too\n"
+       "  noanon                stink: only the page cache stinks\n"
        "\n"
        "   Examples                        Description\n"
        "----------------        ---------------------\n"
@@ -33,18 +66,165 @@ int help(void) {
        "curse nocache +         enable curse 'nocache' \n"
        "curse nocache 7423?     show if process 7423 is cursed with 'nocache' \n"
        "curse nocache 7423+     curse process 7423 with 'nocache' \n"
+       "curse nocache 7423+ wavelength=1048576 async\n"
+       "                        same, evicting every MB from a workqueue\n"
        "\n"
     );
     exit(-1);
     return -1;
 }
 
+int parse_param(struct curse_params *params, const char *param) {
+    unsigned int value;
+
+    if (sscanf(param, "wavelength=%u", &value) == 1 && value > 0) {
+        params->nocache_wavelength = value;
+        params->set |= CURSE_PARAM_NOCACHE_WAVELENGTH;
+    }
+    else if (strcmp(param, "mode=dropbehind") == 0) {
+        params->nocache_mode = CURSE_NOCACHE_MODE_DROPBEHIND;
+        params->set |= CURSE_PARAM_NOCACHE_MODE;
+    }
+    else if (strcmp(param, "mode=wholefile") == 0) {
+        params->nocache_mode = CURSE_NOCACHE_MODE_WHOLEFILE;
+        params->set |= CURSE_PARAM_NOCACHE_MODE;
+    }
+    else if (strcmp(param, "async") == 0) {
+        params->nocache_flags |= CURSE_NOCACHE_ASYNC;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "sync") == 0) {
+        params->nocache_flags &= ~CURSE_NOCACHE_ASYNC;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "adaptive") == 0) {
+        params->nocache_flags |= CURSE_NOCACHE_ADAPTIVE;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "fixed") == 0) {
+        params->nocache_flags &= ~CURSE_NOCACHE_ADAPTIVE;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "writebehind") == 0) {
+        params->nocache_flags |= CURSE_NOCACHE_WRITEBEHIND;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "nowritebehind") == 0) {
+        params->nocache_flags &= ~CURSE_NOCACHE_WRITEBEHIND;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "demote") == 0) {
+        params->nocache_flags |= CURSE_NOCACHE_DEMOTE;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "evict") == 0) {
+        params->nocache_flags &= ~CURSE_NOCACHE_DEMOTE;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "owned") == 0) {
+        params->nocache_flags |= CURSE_NOCACHE_OWNED;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "all") == 0) {
+        params->nocache_flags &= ~CURSE_NOCACHE_OWNED;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "streams") == 0) {
+        params->nocache_flags |= CURSE_NOCACHE_STREAMS;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (strcmp(param, "nostreams") == 0) {
+        params->nocache_flags &= ~CURSE_NOCACHE_STREAMS;
+        params->set |= CURSE_PARAM_NOCACHE_FLAGS;
+    }
+    else if (sscanf(param, "budget=%u", &value) == 1) {
+        params->nocache_budget = value;
+        params->set |= CURSE_PARAM_NOCACHE_BUDGET;
+    }
+    else if (sscanf(param, "backlog=%u", &value) == 1) {
+        params->nocache_backlog_max = value;
+        params->set |= CURSE_PARAM_NOCACHE_BACKLOG_MAX;
+    }
+    else if (sscanf(param, "period=%u", &value) == 1) {
+        params->nocache_period_ms = value;
+        params->set |= CURSE_PARAM_NOCACHE_PERIOD;
+    }
+    else if (sscanf(param, "faults=%u", &value) == 1 && value > 0) {
+        params->nocache_fault_wavelength = value;
+        params->set |= CURSE_PARAM_NOCACHE_FAULT_WAVELENGTH;
+    }
+    else if (strcmp(param, "reckless=async") == 0) {
+        params->reckless_mode = CURSE_RECKLESS_MODE_ASYNC;
+        params->set |= CURSE_PARAM_RECKLESS_MODE;
+    }
+    else if (strcmp(param, "reckless=noop") == 0) {
+        params->reckless_mode = CURSE_RECKLESS_MODE_NOOP;
+        params->set |= CURSE_PARAM_RECKLESS_MODE;
+    }
+    else if (strcmp(param, "anon") == 0) {
+        params->stink_flags |= CURSE_STINK_ANON;
+        params->set |= CURSE_PARAM_STINK_FLAGS;
+    }
+    else if (strcmp(param, "noanon") == 0) {
+        params->stink_flags &= ~CURSE_STINK_ANON;
+        params->set |= CURSE_PARAM_STINK_FLAGS;
+    }
+    else if (sscanf(param, "quota=%u", &value) == 1 && value > 0) {
+        params->cachequota_pages = value;
+        params->set |= CURSE_PARAM_CACHEQUOTA_PAGES;
+    }
+    else if (sscanf(param, "bps=%u", &value) == 1) {
+        params->throttle_bps = value;
+        params->set |= CURSE_PARAM_THROTTLE_BPS;
+    }
+    else if (sscanf(param, "iops=%u", &value) == 1) {
+        params->throttle_iops = value;
+        params->set |= CURSE_PARAM_THROTTLE_IOPS;
+    }
+    else if (sscanf(param, "dirty=%u", &value) == 1 && value > 0) {
+        params->dirtylimit_pages = value;
+        params->set |= CURSE_PARAM_DIRTYLIMIT_PAGES;
+    }
+    else {
+        printf("Invalid parameter: '%s'\n", param);
+        return -1;
+    }
+    return 0;
+}
+
+int print_params(struct curse_params *params) {
+    printf("nocache wavelength: %u bytes%s\n", params->nocache_wavelength,
+           params->nocache_flags & CURSE_NOCACHE_ADAPTIVE ? ", adaptive" : "");
+    printf("nocache mode:       %s\n",
+           params->nocache_mode == CURSE_NOCACHE_MODE_WHOLEFILE ? "wholefile" : "dropbehind");
+    printf("nocache eviction:   %s%s%s%s%s\n",
+           params->nocache_flags & CURSE_NOCACHE_ASYNC ? "async" : "sync",
+           params->nocache_flags & CURSE_NOCACHE_WRITEBEHIND ? ", write-behind" : "",
+           params->nocache_flags & CURSE_NOCACHE_DEMOTE ? ", demote" : "",
+           params->nocache_flags & CURSE_NOCACHE_OWNED ? ", owned pages only" : "",
+           params->nocache_flags & CURSE_NOCACHE_STREAMS ? ", streams only" : "");
+    printf("nocache budget:     %u pages\n", params->nocache_budget);
+    printf("nocache backlog:    %u\n", params->nocache_backlog_max);
+    printf("nocache period:     %u ms\n", params->nocache_period_ms);
+    printf("nocache faults:     %u pages\n", params->nocache_fault_wavelength);
+    printf("dirtylimit:         %u pages\n", params->dirtylimit_pages);
+    printf("recklessness:       %s\n",
+           params->reckless_mode == CURSE_RECKLESS_MODE_NOOP ? "noop" : "async");
+    printf("cachequota:         %u pages\n", params->cachequota_pages);
+    printf("throttle:           %u bytes/s, %u ops/s\n", params->throttle_bps, params->throttle_iops);
+    printf("stink:              %s\n",
+           params->stink_flags & CURSE_STINK_ANON ? "page cache, anonymous" : "page cache");
+    return 0;
+}
+
 int main(int argc, char **argv) {
     pid_t pid;
     char action;
     int status;
     struct curse_list_t *node;
+    struct curse_params params;
     char tmp[10];
+    int i;
 
     if (argc == 2) {
         if (strcmp(argv[1], "list") == 0) {
@@ -55,7 +235,10 @@ int main(int argc, char **argv) {
             return 0;
         }
     }
-    else if (argc == 3) {
+    else if (argc >= 3) {
+        if (argc > 3 && !isdigit(argv[2][0])) {
+            return help();
+        }
         switch (argv[2][0]) {
             case '?':
                 printf("Curse '%s' is globally ", argv[1]);
@@ -102,14 +285,33 @@ int main(int argc, char **argv) {
                             }
                             return 0;
                         case '+':
+                            /* flags are set as a whole, start from the current ones */
+                            memset(&params, 0, sizeof(params));
+                            curse_get_params(argv[1], pid, &params);
+                            params.set = 0;
+                            for (i = 3; i < argc; ++i) {
+                                if (parse_param(&params, argv[i]) < 0) {
+                                    return help();
+                                }
+                            }
                             printf("Enabling curse '%s' for process %i.\n", argv[1], pid);
-                            if (curse_cast(argv[1], pid) == 0) {
+                            if (curse_cast_params(argv[1], pid, &params) == 0) {
                                 printf("Process was successfully cursed.\n");
                             }
                             else {
                                 printf("Failed to curse process. Do you have permission to do that? Is the curse globally enabled?\n");
                             }
                             return 0;
+                        case '=':
+                            memset(&params, 0, sizeof(params));
+                            if (curse_get_params(argv[1], pid, &params) == 0) {
+                                printf("Curse parameters of process %i:\n", pid);
+                                print_params(&params);
+                            }
+                            else {
+                                printf("Failed to read curse parameters. Do you have permission to do that?\n");
+                            }
+                            return 0;
                         case '-':
                             printf("Disabling curse '%s' for process %i.\n", argv[1], pid);
                             if (curse_lift(argv[1], pid) == 0) {
@@ -11,6 +11,7 @@
 #define CURSE_CMD_CURSE_STATUS               5
 #define CURSE_CMD_CURSE_CAST                 6
 #define CURSE_CMD_CURSE_LIFT                 7
+#define CURSE_CMD_CURSE_GET_PARAMS           8
 
 #include "libcurse.h"
 
@@ -42,6 +43,16 @@ long curse_lift(curse_id_t curse_id, pid_t pid) {
     return curse(CURSE_CMD_CURSE_LIFT, curse_id, pid, NULL);
 }
 
+long curse_cast_params(curse_id_t curse_id, pid_t pid, struct curse_params *params) {
+    params->size = sizeof(struct curse_params);
+    return curse(CURSE_CMD_CURSE_CAST, curse_id, pid, params);
+}
+
+long curse_get_params(curse_id_t curse_id, pid_t pid, struct curse_params *params) {
+    params->size = sizeof(struct curse_params);
+    return curse(CURSE_CMD_CURSE_GET_PARAMS, curse_id, pid, params);
+}
+
 struct curse_list_t *curse_get_list(void) {
     struct curse_list_t *curse_list = (struct curse_list_t*)malloc(sizeof(struct curse_list_t));
     struct curse_list_t *next = curse_list, *tmp;
@@ -22,6 +22,8 @@ long curse_disable(curse_id_t curse);
 long curse_status(curse_id_t curse, pid_t pid);
 long curse_cast(curse_id_t curse, pid_t pid);
 long curse_lift(curse_id_t curse, pid_t pid);
+long curse_cast_params(curse_id_t curse, pid_t pid, struct curse_params *params);
+long curse_get_params(curse_id_t curse, pid_t pid, struct curse_params *params);
 struct curse_list_t *curse_get_list(void);
 int curse_print_list(struct curse_list_t *curse_list, char *separator);
 
@@ -332,6 +332,8 @@ ssize_t vfs_read(struct file *file, char __user *buf, size_t count, loff_t *pos)
 			add_rchar(current, ret);
 		}
 		inc_syscr(current);
+		curse_nocache_checkpoint(file, *pos, ret);
+		curse_throttle_checkpoint(file, ret);
 	}
 
 	return ret;
@@ -388,6 +390,9 @@ ssize_t vfs_write(struct file *file, const char __user *buf, size_t count, loff_
 			add_wchar(current, ret);
 		}
 		inc_syscw(current);
+		curse_dirtylimit_checkpoint(file, *pos, ret);
+		curse_nocache_checkpoint(file, *pos, ret);
+		curse_throttle_checkpoint(file, ret);
 	}
 
 	return ret;
@@ -417,7 +422,6 @@ SYSCALL_DEFINE3(read, unsigned int, fd, char __user *, buf, size_t, count)
 		ret = vfs_read(file, buf, count, &pos);
 		file_pos_write(file, pos);
 		fput_light(file, fput_needed);
-        curse_nocache_checkpoint(ret);
 	}
 
 	return ret;
@@ -436,7 +440,6 @@ SYSCALL_DEFINE3(write, unsigned int, fd, const char __user *, buf,
 		ret = vfs_write(file, buf, count, &pos);
 		file_pos_write(file, pos);
 		fput_light(file, fput_needed);
-        curse_nocache_checkpoint(ret);
 	}
 
 	return ret;
@@ -694,6 +697,10 @@ static ssize_t do_readv_writev(int type, struct file *file,
 						pos, fnv);
 	else
 		ret = do_loop_readv_writev(file, iov, nr_segs, pos, fn);
+	if (type == WRITE)
+		curse_dirtylimit_checkpoint(file, *pos, ret);
+	curse_nocache_checkpoint(file, *pos, ret);
+	curse_throttle_checkpoint(file, ret);
 
 out:
 	if (iov != iovstack)
@@ -900,6 +907,10 @@ static ssize_t do_sendfile(int out_fd, int in_fd, loff_t *ppos,
 		fl = SPLICE_F_NONBLOCK;
 #endif
 	retval = do_splice_direct(in_file, ppos, out_file, count, fl);
+	curse_dirtylimit_checkpoint(out_file, out_file->f_pos, retval);
+	curse_nocache_checkpoint(in_file, *ppos, retval);
+	curse_nocache_checkpoint(out_file, out_file->f_pos, retval);
+	curse_throttle_checkpoint(in_file, retval);
 
 	if (retval > 0) {
 		add_rchar(current, retval);
@@ -1,6 +1,8 @@
 #ifndef _CURSE_H
 #define _CURSE_H
 
+#include <linux/types.h>
+
 /* define the sys_curse functions */
 
 #define CURSE_CMD_GET_CURSES_LIST            1
@@ -10,23 +12,487 @@
 #define CURSE_CMD_CURSE_STATUS               5
 #define CURSE_CMD_CURSE_CAST                 6
 #define CURSE_CMD_CURSE_LIFT                 7
+#define CURSE_CMD_CURSE_GET_PARAMS           8
 
 #define MAX_NAME_LIST_NAME_LEN              32
 #define MAX_NUM_CURSES                      32
 
+/* nocache eviction modes */
+#define CURSE_NOCACHE_MODE_DROPBEHIND        1   /* pages behind the position */
+#define CURSE_NOCACHE_MODE_WHOLEFILE         2   /* every page of the file */
+
+/* nocache flags */
+#define CURSE_NOCACHE_ASYNC                  0x1 /* evict from a workqueue */
+#define CURSE_NOCACHE_ADAPTIVE               0x2 /* scale wavelength with free memory */
+#define CURSE_NOCACHE_WRITEBEHIND            0x4 /* evict written pages once written back */
+#define CURSE_NOCACHE_DEMOTE                 0x8 /* leave pages to reclaim instead of evicting */
+#define CURSE_NOCACHE_OWNED                  0x10 /* only evict pages the task brought in */
+#define CURSE_NOCACHE_STREAMS                0x20 /* only evict files moved sequentially */
+#define CURSE_NOCACHE_FLAGS_ALL              0x3f
+
+/* recklessness modes */
+#define CURSE_RECKLESS_MODE_ASYNC            1   /* start writeback, do not wait for it */
+#define CURSE_RECKLESS_MODE_NOOP             2   /* do nothing at all */
+
+/* stink flags */
+#define CURSE_STINK_ANON                     0x1 /* anonymous memory stinks too */
+#define CURSE_STINK_FLAGS_ALL                0x1
+
+/* curse parameters, passed to CURSE_CMD_CURSE_CAST through addr and
+   read back with CURSE_CMD_CURSE_GET_PARAMS.
+   size must be set to sizeof(struct curse_params), so the structure
+   can grow without breaking older callers. At cast time only the
+   fields named in set are applied, the others keep their current
+   value, which for a task that was never cursed is the global default
+   from /proc/sys/kernel/curse/. Casting a curse that is already cast
+   changes its parameters on the fly.
+*/
+struct curse_params {
+    __u32 size;
+    __u32 set;                          /* CURSE_PARAM_* */
+
+    /* nocache */
+    __u32 nocache_wavelength;           /* bytes between two evictions */
+    __u32 nocache_mode;                 /* CURSE_NOCACHE_MODE_* */
+    __u32 nocache_flags;                /* CURSE_NOCACHE_* */
+    __u32 nocache_budget;               /* pages per checkpoint, 0 for no limit */
+    __u32 nocache_backlog_max;          /* async evictions in flight */
+    __u32 nocache_period_ms;            /* evict every so often, 0 for never */
+    __u32 nocache_fault_wavelength;     /* mmap faults between two evictions */
+
+    /* dirtylimit */
+    __u32 dirtylimit_pages;             /* pages written between two flushes */
+
+    /* recklessness */
+    __u32 reckless_mode;                /* CURSE_RECKLESS_MODE_* */
+
+    /* stink */
+    __u32 stink_flags;                  /* CURSE_STINK_* */
+
+    /* cachequota */
+    __u32 cachequota_pages;             /* page cache the task may keep */
+
+    /* throttle */
+    __u32 throttle_bps;                 /* bytes per second, 0 for no limit */
+    __u32 throttle_iops;                /* reads and writes per second, 0 for no limit */
+};
+
+#define CURSE_PARAMS_SIZE_VER0              28
+#define CURSE_PARAMS_SIZE_VER1              32  /* nocache_period_ms */
+#define CURSE_PARAMS_SIZE_VER2              36  /* nocache_fault_wavelength */
+#define CURSE_PARAMS_SIZE_VER3              40  /* dirtylimit_pages */
+#define CURSE_PARAMS_SIZE_VER4              44  /* reckless_mode */
+#define CURSE_PARAMS_SIZE_VER5              48  /* stink_flags */
+#define CURSE_PARAMS_SIZE_VER6              52  /* cachequota_pages */
+#define CURSE_PARAMS_SIZE_VER7              56  /* throttle_bps */
+#define CURSE_PARAMS_SIZE_VER8              60  /* throttle_iops */
+
+#define CURSE_PARAM_NOCACHE_WAVELENGTH      0x0001
+#define CURSE_PARAM_NOCACHE_MODE            0x0002
+#define CURSE_PARAM_NOCACHE_FLAGS           0x0004
+#define CURSE_PARAM_NOCACHE_BUDGET          0x0008
+#define CURSE_PARAM_NOCACHE_BACKLOG_MAX     0x0010
+#define CURSE_PARAM_NOCACHE_PERIOD          0x0020
+#define CURSE_PARAM_NOCACHE_FAULT_WAVELENGTH 0x0040
+#define CURSE_PARAM_DIRTYLIMIT_PAGES        0x0080
+#define CURSE_PARAM_RECKLESS_MODE           0x0100
+#define CURSE_PARAM_STINK_FLAGS             0x0200
+#define CURSE_PARAM_CACHEQUOTA_PAGES        0x0400
+#define CURSE_PARAM_THROTTLE_BPS            0x0800
+#define CURSE_PARAM_THROTTLE_IOPS           0x1000
+#define CURSE_PARAM_ALL                     0x1fff
+
 #ifdef __KERNEL__
 /* this section is needed only when including from kernel source */
 
-#include <linux/types.h>
+struct task_struct;
+struct file;
+struct vm_area_struct;
+struct page;
+struct inode;
+
+#ifdef CONFIG_CURSE
+
+#include <linux/jump_label.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/pagevec.h>
+#include <asm/atomic.h>
+
+/* curse indices, into the curse tables and the per-task curse bitmap */
+#define CURSE_STINK    0
+#define CURSE_NOCACHE  1
+#define CURSE_RECKLESSNESS 2
+#define CURSE_DIRTYLIMIT 3
+#define CURSE_CACHEQUOTA 4
+#define CURSE_THROTTLE 5
+
+/* files a nocache-cursed task may touch between two checkpoints
+   before the checkpoint is brought forward
+*/
+#define CURSE_NOCACHE_TOUCHED_MAX 8
+
+/* a file touched since the last checkpoint and the byte range
+   the task has consumed from it; once eviction has started, start
+   is where it resumes.
+   In write-behind mode, wb_start to wb_end is what earlier windows
+   left dirty or under writeback, to be dropped once it is written.
+   Nothing is pinned, so that close(), flock() and umount never wait
+   for a curse: eviction looks the mapping up again among the files
+   and mappings the task still has, and leaves what it closed
+   meanwhile to reclaim
+*/
+struct curse_touched_file {
+    struct address_space *mapping;      /* only compared, not pinned */
+    loff_t start;
+    loff_t end;
+    loff_t wb_start;
+    loff_t wb_end;
+};
+
+/* an inode, by name rather than by reference: state that outlives
+   the task's use of a file must not keep the inode from being evicted,
+   or its filesystem from being unmounted. Looked up again in the inode
+   cache when needed, and the generation tells a reused inode number
+*/
+struct curse_inode_id {
+    dev_t dev;
+    unsigned long ino;
+    __u32 generation;
+};
+
+/* pages start to end inclusive of a mapping, brought into the page
+   cache by a nocache-cursed task itself
+*/
+#define CURSE_NOCACHE_EXTENTS_MAX 32
+
+struct curse_extent {
+    struct curse_inode_id id;
+    pgoff_t start;
+    pgoff_t end;
+};
+
+/* where the task's last read or write of a file ended, and where the
+   sequential run leading up to it began
+*/
+#define CURSE_NOCACHE_STREAMS_MAX 16
+
+struct curse_stream {
+    struct file *file;                  /* only compared, not pinned */
+    struct address_space *mapping;      /* of file, only compared */
+    loff_t begin;
+    loff_t next;
+    unsigned int calls;                 /* that moved data since begin */
+};
+
+/* per-task curse state; attached the first time a task is cursed and
+   freed together with its task_struct, so tasks that are never cursed
+   only pay for the task_struct->curse pointer
+*/
+struct curse_state {
+    unsigned long curses;               /* cast curses, atomic bitops only */
+    struct task_struct *task;           /* whose state this is */
+
+    spinlock_t lock;                    /* protects the touched set */
+
+    struct curse_params params;         /* as set at cast time */
+
+    /* nocache */
+    atomic_t nocache_cnt;               /* bytes moved since the last vanish */
+    atomic_t nocache_backlog;           /* evictions queued, not yet done */
+    /* files read or written since the last vanish, and files whose
+       eviction ran out of budget, oldest first
+    */
+    struct curse_touched_file nocache_touched[CURSE_NOCACHE_TOUCHED_MAX];
+    unsigned int nocache_nr_touched;
+    /* timed eviction, every params.nocache_period_ms while there is I/O */
+    struct hrtimer nocache_timer;
+    struct work_struct nocache_timer_work;
+    unsigned long nocache_timer_state;  /* CURSE_TIMER_*, atomic bitops only */
+    /* mmap'd files faulted in since the last unmap, in file offsets;
+       these have to be unmapped before they can be evicted
+    */
+    struct curse_touched_file nocache_mapped[CURSE_NOCACHE_TOUCHED_MAX];
+    unsigned int nocache_nr_mapped;
+    atomic_t nocache_fault_cnt;         /* pages faulted since the last unmap */
+    struct work_struct nocache_fault_work; /* unmaps and evicts them */
+    struct mm_struct *nocache_fault_mm; /* pinned for the work; under lock */
+    /* with CURSE_NOCACHE_OWNED, the pages the task brought in and has
+       not evicted yet, oldest first; under lock
+    */
+    struct curse_extent nocache_owned[CURSE_NOCACHE_EXTENTS_MAX];
+    unsigned int nocache_nr_owned;
+    /* with CURSE_NOCACHE_STREAMS, the files recently read or written,
+       only ever touched by the task itself
+    */
+    struct curse_stream nocache_streams[CURSE_NOCACHE_STREAMS_MAX];
+    unsigned int nocache_nr_streams;
+    unsigned int nocache_stream_next;   /* the slot to recycle next */
+
+    /* statistics, only ever updated by the task itself */
+    unsigned long nocache_checkpoints;
+    unsigned long nocache_vanishes;
+    unsigned long nocache_queued;       /* evictions handed to the workqueue */
+    unsigned long nocache_deferred;     /* vanishes cut short by the budget */
+    unsigned long nocache_faults;       /* mmap faults accounted */
+    unsigned long nocache_unmaps;       /* unmap windows ended */
+    unsigned long nocache_random;       /* reads and writes left cached */
+
+    /* dirtylimit, only ever touched by the task itself but for the
+       release of the set on lift
+    */
+    struct curse_touched_file dirtylimit_files[CURSE_NOCACHE_TOUCHED_MAX];
+    unsigned int dirtylimit_nr_files;
+    unsigned long dirtylimit_bytes;     /* written since the last flush */
+    unsigned long dirtylimit_flushes;
+
+    /* recklessness, only updated by the task itself */
+    unsigned long reckless_elided;      /* syncs not waited for */
+
+    /* stink: pages the task brought into the page cache, waiting to be
+       moved to the tail of the inactive list; under lock
+    */
+    struct pagevec stink_pvec;
+    unsigned long stink_pages;          /* pages rotated */
+
+    /* cachequota: the files the task brought pages in from, most
+       recently used first; under lock
+    */
+    struct list_head cachequota_files;
+    unsigned int cachequota_nr_files;
+    unsigned long cachequota_charged;   /* pages brought in and not evicted */
+    struct curse_inode_id cachequota_current; /* charged last */
+    int cachequota_force;               /* the LRU is full, shrink anyway */
+    struct work_struct cachequota_work; /* shrinks over quota */
+    /* statistics, only ever updated by the work */
+    unsigned long cachequota_shrinks;
+    unsigned long cachequota_evicted;
+    /* throttle: time credit of the byte and the op bucket, in ns, and
+       when it was last topped up; only ever touched by the task itself
+    */
+    ktime_t throttle_stamp;
+    s64 throttle_bytes_credit;
+    s64 throttle_ops_credit;
+    unsigned long throttle_waits;       /* times the task was put to sleep */
+
+    /* also updated from the workqueue */
+    atomic_long_t nocache_evicted;      /* pages invalidated, or demoted */
+    atomic_long_t nocache_spared;       /* owned pages another task used */
+    unsigned long nocache_timer_passes; /* only by the timer work */
+};
+
+int curse_fork(struct task_struct *p);
+void curse_exit(struct task_struct *tsk);
+void curse_free_task(struct task_struct *tsk);
 
 int curse_global_status(int curse_id);
 int curse_global_enable(int curse_id);
 int curse_global_disable(int curse_id);
 
-void curse_nocache_checkpoint(int);
+/* set while the nocache curse is globally enabled */
+extern int curse_nocache_active;
+/* set while the dirtylimit curse is globally enabled */
+extern int curse_dirtylimit_active;
+/* set while the recklessness curse is globally enabled */
+extern int curse_reckless_active;
+/* set while the stink curse is globally enabled */
+extern int curse_stink_active;
+/* set while the throttle curse is globally enabled */
+extern int curse_throttle_active;
+/* the number of globally enabled curses with page cache hooks,
+   stink, nocache and cachequota
+*/
+extern int curse_page_cache_active;
+
+void __curse_nocache_checkpoint(struct file *file, loff_t pos, ssize_t amount);
+void __curse_nocache_fault(struct vm_area_struct *vma, pgoff_t pgoff);
+void __curse_dirtylimit_checkpoint(struct file *file, loff_t pos, ssize_t amount);
+void __curse_throttle_checkpoint(struct file *file, ssize_t amount);
+int __curse_reckless_fsync(struct file *file, loff_t start, loff_t end);
+unsigned int __curse_reckless_sync_file_range(struct file *file, unsigned int flags);
+void __curse_page_cache_add(struct page *page);
+int __curse_page_accessed(struct page *page);
+int __curse_stink_anon_lru(int lru);
+
+/* this checkpoint sits in vfs_read(), vfs_write(), do_readv_writev()
+   and compat_do_readv_writev(), so that read, pread64, readv, preadv
+   and their write counterparts all go through it, for 32-bit tasks
+   too; pos is the file position after the transfer of amount bytes.
+   sendfile() calls it once per transfer, for each side, after
+   do_splice_direct(); splice() calls it from do_splice() for the side
+   that is a file, and AIO from aio_rw_vect_retry() once a buffered
+   transfer is done.
+   It costs a single NOP until the nocache curse is globally enabled
+*/
+static inline void curse_nocache_checkpoint(struct file *file, loff_t pos, ssize_t amount)
+{
+    JUMP_LABEL(&curse_nocache_active, do_checkpoint);
+    return;
+do_checkpoint:
+    __curse_nocache_checkpoint(file, pos, amount);
+}
+
+/* the mmap counterpart of the checkpoint, called from filemap_fault()
+   with mmap_sem held for reading once the page at pgoff of the file
+   behind vma is in the page cache and about to be mapped. The page is
+   locked, so it only records the fault and never sleeps; unmapping
+   and eviction are left to the workqueue.
+   A task walking a file through a mapping never calls read(); this is
+   the only place where its I/O can be seen
+*/
+static inline void curse_nocache_fault(struct vm_area_struct *vma, pgoff_t pgoff)
+{
+    JUMP_LABEL(&curse_nocache_active, do_fault);
+    return;
+do_fault:
+    __curse_nocache_fault(vma, pgoff);
+}
+
+/* called after buffered writes, from vfs_write(), do_readv_writev(),
+   compat_do_readv_writev(), do_sendfile(), do_splice() and
+   aio_rw_vect_retry(), ahead of the nocache checkpoint so that the
+   pages it cleans can be dropped right away; pos is the file position
+   after amount bytes were written
+*/
+static inline void curse_dirtylimit_checkpoint(struct file *file, loff_t pos, ssize_t amount)
+{
+    JUMP_LABEL(&curse_dirtylimit_active, do_checkpoint);
+    return;
+do_checkpoint:
+    __curse_dirtylimit_checkpoint(file, pos, amount);
+}
+
+/* called after reads and writes, from vfs_read(), vfs_write(),
+   do_readv_writev(), compat_do_readv_writev(), do_sendfile(),
+   do_splice() and aio_rw_vect_retry(), once the other checkpoints are
+   done; may sleep until the task is back within its rates, but only
+   on I/O to user memory, never under set_fs(KERNEL_DS)
+*/
+static inline void curse_throttle_checkpoint(struct file *file, ssize_t amount)
+{
+    JUMP_LABEL(&curse_throttle_active, do_checkpoint);
+    return;
+do_checkpoint:
+    __curse_throttle_checkpoint(file, amount);
+}
+
+/* called first thing in vfs_fsync_range(); nonzero means the task is
+   reckless and the sync has been dealt with, so return 0 right away.
+   fsync, fdatasync, msync(MS_SYNC) and the O_SYNC/O_DSYNC writes that
+   go through generic_write_sync() all end up there
+*/
+static inline int curse_reckless_fsync(struct file *file, loff_t start, loff_t end)
+{
+    JUMP_LABEL(&curse_reckless_active, do_fsync);
+    return 0;
+do_fsync:
+    return __curse_reckless_fsync(file, start, end);
+}
+
+/* called from sys_sync_file_range() once the file is looked up;
+   returns the flags to go on with
+*/
+static inline unsigned int curse_reckless_sync_file_range(struct file *file, unsigned int flags)
+{
+    JUMP_LABEL(&curse_reckless_active, do_sync_file_range);
+    return flags;
+do_sync_file_range:
+    return __curse_reckless_sync_file_range(file, flags);
+}
+
+/* called from add_to_page_cache_lru() once the page is queued for the
+   LRU; every page the task reads, faults or writes in passes here
+*/
+static inline void curse_page_cache_add(struct page *page)
+{
+    JUMP_LABEL(&curse_page_cache_active, do_add);
+    return;
+do_add:
+    __curse_page_cache_add(page);
+}
+
+/* called first thing in mark_page_accessed(); nonzero means the
+   access is not to count, so that a stinking task never promotes
+   a page to the active list, and a nocache-cursed one streaming
+   through a page never makes it look used by anybody but itself
+*/
+static inline int curse_page_accessed(struct page *page)
+{
+    JUMP_LABEL(&curse_page_cache_active, do_accessed);
+    return 0;
+do_accessed:
+    return __curse_page_accessed(page);
+}
+
+/* page_add_new_anon_rmap() puts new anonymous pages on the LRU list
+   returned here instead of LRU_ACTIVE_ANON
+*/
+static inline int curse_stink_anon_lru(int lru)
+{
+    JUMP_LABEL(&curse_stink_active, do_anon);
+    return lru;
+do_anon:
+    return __curse_stink_anon_lru(lru);
+}
+
+#else /* !CONFIG_CURSE */
+
+static inline int curse_fork(struct task_struct *p)
+{
+    return 0;
+}
+
+static inline void curse_exit(struct task_struct *tsk)
+{
+}
+
+static inline void curse_free_task(struct task_struct *tsk)
+{
+}
+
+static inline void curse_nocache_checkpoint(struct file *file, loff_t pos, ssize_t amount)
+{
+}
+
+static inline void curse_nocache_fault(struct vm_area_struct *vma, pgoff_t pgoff)
+{
+}
+
+static inline void curse_dirtylimit_checkpoint(struct file *file, loff_t pos, ssize_t amount)
+{
+}
+
+static inline void curse_throttle_checkpoint(struct file *file, ssize_t amount)
+{
+}
+
+static inline int curse_reckless_fsync(struct file *file, loff_t start, loff_t end)
+{
+    return 0;
+}
+
+static inline unsigned int curse_reckless_sync_file_range(struct file *file, unsigned int flags)
+{
+    return flags;
+}
+
+static inline void curse_page_cache_add(struct page *page)
+{
+}
+
+static inline int curse_page_accessed(struct page *page)
+{
+    return 0;
+}
+
+static inline int curse_stink_anon_lru(int lru)
+{
+    return lru;
+}
 
-/* this checkpoint is to be inserted into system calls */
-// void curse_nocache_checkpoint(/* arguments */);
+#endif /* CONFIG_CURSE */
 #endif
 
 #endif
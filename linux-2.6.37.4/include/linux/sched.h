@@ -100,6 +100,7 @@ struct robust_list_head;
 struct bio_list;
 struct fs_struct;
 struct perf_event_context;
+struct curse_state;
 
 /*
  * List of flags we want to share for kernel threads,
@@ -1513,9 +1514,10 @@ struct task_struct {
 	} memcg_batch;
 #endif
 
-    // curse code
-    unsigned int curses;
-    unsigned int curse_fs_no_cache_cnt;
+#ifdef CONFIG_CURSE
+    // curse code, allocated the first time the task is cursed
+    struct curse_state *curse;
+#endif
 };
 
 /* Future-safe accessor for struct task_struct's cpus_allowed. */
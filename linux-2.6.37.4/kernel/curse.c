@@ -1,23 +1,105 @@
 #include <linux/linkage.h>
 /* linux/sched.h includes everything we need */
 #include <linux/sched.h>
-#include <linux/fadvise.h>
 #include <linux/syscalls.h>
 #include <linux/curse.h>
 #include <linux/fdtable.h>
+#include <linux/jump_label.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/pagevec.h>
+#include <linux/swap.h>
+#include <linux/writeback.h>
+#include <linux/backing-dev.h>
+#include <linux/workqueue.h>
+#include <linux/sysctl.h>
+#include <linux/mmzone.h>
+#include <linux/vmstat.h>
+#include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/uaccess.h>
+#include <linux/hash.h>
 
 /* ****************************** */
 /*  Global Curses Initialization  */
 /* ****************************** */
 
-#define CURSE_STINK    0
-#define CURSE_NOCACHE  1
-#define CURSE_RECKLESSNESS 2
 #define CURSE_NO_FS_CACHE_WAVELENGTH 1024
+#define CURSE_NOCACHE_BACKLOG_MAX 64
+#define CURSE_NOCACHE_FAULT_WAVELENGTH 256
+#define CURSE_DIRTYLIMIT_PAGES 1024
+#define CURSE_CACHEQUOTA_PAGES 65536
+#define CURSE_THROTTLE_BPS (16 * 1024 * 1024)
+
+/* parameters of tasks that are cursed for the first time,
+   tunable through /proc/sys/kernel/curse/
+*/
+static struct curse_params curse_default_params = {
+    .size                = sizeof(struct curse_params),
+    .set                 = CURSE_PARAM_ALL,
+    .nocache_wavelength  = CURSE_NO_FS_CACHE_WAVELENGTH,
+    .nocache_mode        = CURSE_NOCACHE_MODE_DROPBEHIND,
+    .nocache_flags       = CURSE_NOCACHE_OWNED | CURSE_NOCACHE_STREAMS,
+    .nocache_budget      = 0,
+    .nocache_backlog_max = CURSE_NOCACHE_BACKLOG_MAX,
+    .nocache_period_ms   = 0,
+    .nocache_fault_wavelength = CURSE_NOCACHE_FAULT_WAVELENGTH,
+    .dirtylimit_pages    = CURSE_DIRTYLIMIT_PAGES,
+    .reckless_mode       = CURSE_RECKLESS_MODE_ASYNC,
+    .stink_flags         = 0,
+    .cachequota_pages    = CURSE_CACHEQUOTA_PAGES,
+    .throttle_bps        = CURSE_THROTTLE_BPS,
+    .throttle_iops       = 0,
+};
+
+/* automatic cursing, see curse_auto_scan(); tunable through
+   /proc/sys/kernel/curse/auto_*
+*/
+#define CURSE_AUTO_OFF     0
+#define CURSE_AUTO_NOCACHE 1
+#define CURSE_AUTO_DEMOTE  2
+
+#define CURSE_AUTO_UIDS_MAX 8
+#define CURSE_AUTO_COMM_LEN 256
+
+static int curse_auto = CURSE_AUTO_OFF;
+static int curse_auto_period_ms = 1000;
+static int curse_auto_rate_kb = 32768;
+static int curse_auto_miss_pct = 50;
+static int curse_auto_exempt_uids[CURSE_AUTO_UIDS_MAX] = { [0 ... CURSE_AUTO_UIDS_MAX - 1] = -1 };
+static char curse_auto_exempt_comm[CURSE_AUTO_COMM_LEN];
+static unsigned long curse_auto_casts;
+/* serializes the scan and the tunables it cannot read atomically */
+static DEFINE_MUTEX(curse_auto_mutex);
+
+/* nocache_timer_state bits */
+#define CURSE_TIMER_ARMED 0
+#define CURSE_TIMER_DEAD  1
 
 /* forward declaration of curses operations */
-static long curse_nocache_enable(pid_t);
-static long curse_nocache_disable(pid_t);
+static long curse_nocache_enable(struct task_struct *);
+static long curse_nocache_disable(struct task_struct *);
+static void curse_nocache_release(struct curse_state *);
+static enum hrtimer_restart curse_nocache_timer_fn(struct hrtimer *);
+static void curse_nocache_timer_work(struct work_struct *);
+static void curse_nocache_timer_stop(struct curse_state *);
+static void curse_nocache_fault_work(struct work_struct *);
+static void curse_nocache_fault_stop(struct curse_state *);
+static long curse_dirtylimit_disable(struct task_struct *);
+static void curse_dirtylimit_release(struct curse_state *);
+static long curse_stink_disable(struct task_struct *);
+static void curse_stink_drain(struct curse_state *);
+static long curse_cachequota_disable(struct task_struct *);
+static void curse_cachequota_release(struct curse_state *);
+static void curse_cachequota_work(struct work_struct *);
+static void curse_auto_scan(struct work_struct *);
+
+static DECLARE_DELAYED_WORK(curse_auto_work, curse_auto_scan);
 
 struct name_list_t {
     int nr_names;
@@ -25,41 +107,228 @@ struct name_list_t {
 };
 
 static struct name_list_t curses_names = {
-                        .nr_names = 3,
+                        .nr_names = 6,
                         .names = { [CURSE_STINK]   = "stink",
                                    [CURSE_NOCACHE] = "nocache",
-                                   [CURSE_RECKLESSNESS] = "recklessness" }
+                                   [CURSE_RECKLESSNESS] = "recklessness",
+                                   [CURSE_DIRTYLIMIT] = "dirtylimit",
+                                   [CURSE_CACHEQUOTA] = "cachequota",
+                                   [CURSE_THROTTLE] = "throttle" }
 };
 
-typedef long (*enable_fn_t)(pid_t pid);
-typedef long (*disable_fn_t)(pid_t pid);
+typedef long (*enable_fn_t)(struct task_struct *target);
+typedef long (*disable_fn_t)(struct task_struct *target);
 
 
 static enable_fn_t  curses_enable_list[]   =
                         { [CURSE_STINK]   = NULL,
                           [CURSE_NOCACHE] = &curse_nocache_enable,
-                          [CURSE_RECKLESSNESS] = NULL };
+                          [CURSE_RECKLESSNESS] = NULL,
+                          [CURSE_DIRTYLIMIT] = NULL,
+                          [CURSE_CACHEQUOTA] = NULL,
+                          [CURSE_THROTTLE] = NULL };
 
 static disable_fn_t curses_disable_list[]  =
-                        { [CURSE_STINK]   = NULL,
+                        { [CURSE_STINK]   = &curse_stink_disable,
                           [CURSE_NOCACHE] = &curse_nocache_disable,
-                          [CURSE_RECKLESSNESS] = NULL };
+                          [CURSE_RECKLESSNESS] = NULL,
+                          [CURSE_DIRTYLIMIT] = &curse_dirtylimit_disable,
+                          [CURSE_CACHEQUOTA] = &curse_cachequota_disable,
+                          [CURSE_THROTTLE] = NULL };
+
+/* jump label keys guarding the hooks a curse has in other subsystems;
+   a hook stays a patched-out NOP until its curse is globally enabled.
+   Hooks shared by several curses count how many of them are enabled
+*/
+int curse_nocache_active;
+EXPORT_SYMBOL(curse_nocache_active);
+int curse_dirtylimit_active;
+EXPORT_SYMBOL(curse_dirtylimit_active);
+int curse_reckless_active;
+EXPORT_SYMBOL(curse_reckless_active);
+int curse_stink_active;
+EXPORT_SYMBOL(curse_stink_active);
+int curse_page_cache_active;
+EXPORT_SYMBOL(curse_page_cache_active);
+int curse_throttle_active;
+EXPORT_SYMBOL(curse_throttle_active);
+
+#define CURSE_HOOK_KEYS_MAX 2
+
+static int *curses_hook_keys[][CURSE_HOOK_KEYS_MAX] =
+                        { [CURSE_STINK]   = { &curse_stink_active, &curse_page_cache_active },
+                          [CURSE_NOCACHE] = { &curse_nocache_active, &curse_page_cache_active },
+                          [CURSE_RECKLESSNESS] = { &curse_reckless_active },
+                          [CURSE_DIRTYLIMIT] = { &curse_dirtylimit_active },
+                          [CURSE_CACHEQUOTA] = { &curse_page_cache_active },
+                          [CURSE_THROTTLE] = { &curse_throttle_active } };
+
+
+/* ************************** */
+/*   Per-task Curse State     */
+/* ************************** */
+
+static struct kmem_cache *curse_state_cachep;
+
+/* asynchronous nocache evictions */
+struct curse_evict_work {
+    struct work_struct work;
+    struct task_struct *task;           /* pinned, owns the backlog */
+    struct curse_touched_file touched;  /* looked up again in the task */
+    unsigned int mode;
+    unsigned int flags;
+};
+
+static struct kmem_cache *curse_evict_cachep;
+static struct workqueue_struct *curse_wq;
+
+/* a file the cachequota curse charges pages to */
+struct curse_quota_file {
+    struct list_head lru;               /* first is most recently used */
+    struct curse_inode_id id;
+    pgoff_t start;                      /* the pages charged lie from start */
+    pgoff_t end;                        /* to end inclusive */
+    unsigned long pages;
+    int referenced;                     /* read again since the last shrink */
+};
+
+static struct kmem_cache *curse_quota_cachep;
+
+static void curse_state_init(struct curse_state *cs) {
+    spin_lock_init(&cs->lock);
+    cs->params = curse_default_params;
+    atomic_set(&cs->nocache_cnt, 0);
+    atomic_set(&cs->nocache_backlog, 0);
+    atomic_set(&cs->nocache_fault_cnt, 0);
+    pagevec_init(&cs->stink_pvec, 0);
+    INIT_LIST_HEAD(&cs->cachequota_files);
+    INIT_WORK(&cs->cachequota_work, curse_cachequota_work);
+    atomic_long_set(&cs->nocache_evicted, 0);
+    atomic_long_set(&cs->nocache_spared, 0);
+    hrtimer_init(&cs->nocache_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    cs->nocache_timer.function = curse_nocache_timer_fn;
+    INIT_WORK(&cs->nocache_timer_work, curse_nocache_timer_work);
+    INIT_WORK(&cs->nocache_fault_work, curse_nocache_fault_work);
+}
+
+/* return the curse state of a task, attaching a fresh one if the task
+   has never been cursed before. The caller must hold a reference to
+   the task; the state lives exactly as long as the task_struct does,
+   so it is never freed under anybody who can see the task
+*/
+static struct curse_state *curse_state_get(struct task_struct *tsk) {
+    struct curse_state *cs, *old;
+
+    cs = ACCESS_ONCE(tsk->curse);
+    if (cs != NULL) {
+        return cs;
+    }
+
+    cs = kmem_cache_zalloc(curse_state_cachep, GFP_KERNEL);
+    if (cs == NULL) {
+        return NULL;
+    }
+    curse_state_init(cs);
+    cs->task = tsk;
+
+    /* two casters may race to attach state to the same task */
+    old = cmpxchg(&tsk->curse, NULL, cs);
+    if (old != NULL) {
+        kmem_cache_free(curse_state_cachep, cs);
+        return old;
+    }
+    return cs;
+}
+
+/* called from copy_process(): dup_task_struct() copied the parent's
+   state pointer, give the child a state of its own instead.
+   Curses and their parameters are inherited,
+   the counters and statistics are not.
+*/
+int curse_fork(struct task_struct *p) {
+    struct curse_state *parent_cs = p->curse, *cs;
+
+    p->curse = NULL;
+    if (parent_cs == NULL || parent_cs->curses == 0) {
+        return 0;
+    }
+
+    cs = kmem_cache_zalloc(curse_state_cachep, GFP_KERNEL);
+    if (cs == NULL) {
+        return -ENOMEM;
+    }
+    curse_state_init(cs);
+    cs->task = p;
+    cs->curses = parent_cs->curses;
+    cs->params = parent_cs->params;
+
+    p->curse = cs;
+    return 0;
+}
+
+/* called from do_exit(): drop whatever the state still pins */
+void curse_exit(struct task_struct *tsk) {
+    if (tsk->curse != NULL) {
+        curse_nocache_timer_stop(tsk->curse);
+        curse_nocache_fault_stop(tsk->curse);
+        curse_nocache_release(tsk->curse);
+        curse_dirtylimit_release(tsk->curse);
+        curse_stink_drain(tsk->curse);
+        cancel_work_sync(&tsk->curse->cachequota_work);
+        curse_cachequota_release(tsk->curse);
+    }
+}
+
+/* called from free_task() */
+void curse_free_task(struct task_struct *tsk) {
+    if (tsk->curse != NULL) {
+        kmem_cache_free(curse_state_cachep, tsk->curse);
+        tsk->curse = NULL;
+    }
+}
+
+static int __init curse_init(void) {
+    curse_state_cachep = KMEM_CACHE(curse_state, SLAB_PANIC);
+    curse_evict_cachep = KMEM_CACHE(curse_evict_work, SLAB_PANIC);
+    curse_quota_cachep = KMEM_CACHE(curse_quota_file, SLAB_PANIC);
+    /* unbound, so that the evictions of a task with many files
+       spread over all CPUs instead of queueing on the one it runs on
+    */
+    curse_wq = alloc_workqueue("curse", WQ_UNBOUND, 0);
+    BUG_ON(curse_wq == NULL);
+    return 0;
+}
+core_initcall(curse_init);
 
 
 /* ************************** */
 /*  Global Curses Management  */
 /* ************************** */
 
-static int curses_status = 0xffffffff;
+/* all curses start globally disabled, so that a kernel which never
+   uses them runs with every curse hook patched out
+*/
+static int curses_status = 0;
+
+/* serializes global enable/disable and the jump label patching */
+static DEFINE_MUTEX(curses_status_mutex);
 
-unsigned int curse_index_from_id(curse_id_t curse_id) {
+/* the index of the curse named by the user string curse_id, or a
+   negative errno; the result is always within curses_names and safe
+   to index the curse bitmaps and tables with
+*/
+int curse_index_from_id(curse_id_t curse_id) {
     int i;
     int r;
     char namebuf[MAX_NAME_LIST_NAME_LEN];
 
     r = strncpy_from_user(namebuf, curse_id, MAX_NAME_LIST_NAME_LEN);
-    if (r <= 0) {
-        return r;
+    if (r < 0) {
+        return -EFAULT;
+    }
+    /* empty, or too long to be any curse's name */
+    if (r == 0 || r == MAX_NAME_LIST_NAME_LEN) {
+        return -EINVAL;
     }
 
     for (i = 0; i < curses_names.nr_names; ++i) {
@@ -67,7 +336,7 @@ unsigned int curse_index_from_id(curse_id_t curse_id) {
             return i;
         }
     }
-    return -1;
+    return -EINVAL;
 }
 
 int curse_global_status(int curse_index) {
@@ -75,26 +344,492 @@ int curse_global_status(int curse_index) {
 }
 
 int curse_global_enable(int curse_index) {
-    const struct cred *own_creds = get_current_cred();
+    int i, *key;
 
-    if (own_creds->euid == 0) {
+    if (current_euid() != 0) {
+        printk(KERN_DEBUG "curse_global_enable permission denied.\n");
+        return -EACCES;
+    }
+
+    mutex_lock(&curses_status_mutex);
+    if (!curse_global_status(curse_index)) {
         curses_status |= 1 << curse_index;
-        return 0;
+        /* the curse is visible as enabled before its hooks go live */
+        for (i = 0; i < CURSE_HOOK_KEYS_MAX; ++i) {
+            key = curses_hook_keys[curse_index][i];
+            if (key != NULL && (*key)++ == 0) {
+                jump_label_enable(key);
+            }
+        }
     }
-    printk(KERN_DEBUG "curse_global_enable permission denied.\n");
-    return -EACCES;
+    mutex_unlock(&curses_status_mutex);
+    return 0;
 }
 
 int curse_global_disable(int curse_index) {
-    const struct cred *own_creds = get_current_cred();
+    int i, *key;
 
-    if (own_creds->euid == 0) {
+    if (current_euid() != 0) {
+        printk(KERN_DEBUG "curse_global_disable permission denied.\n");
+        return -EACCES;
+    }
+
+    mutex_lock(&curses_status_mutex);
+    if (curse_global_status(curse_index)) {
+        for (i = 0; i < CURSE_HOOK_KEYS_MAX; ++i) {
+            key = curses_hook_keys[curse_index][i];
+            if (key != NULL && --(*key) == 0) {
+                jump_label_disable(key);
+            }
+        }
         curses_status &= ~(1 << curse_index);
-        return 0;
     }
-    printk(KERN_DEBUG "curse_global_disable permission denied.\n");
-    return -EACCES;
+    mutex_unlock(&curses_status_mutex);
+    return 0;
+}
+
+/* ************************** */
+/*      Curse Parameters      */
+/* ************************** */
+
+/* adaptive nocache wavelength.
+   The wavelength of tasks with CURSE_NOCACHE_ADAPTIVE is scaled by
+   2^curse_adaptive_shift. The shift is -min_shift while free memory
+   is below the low watermarks, i.e. while kswapd is reclaiming, and
+   grows linearly with free + inactive file memory, measured in
+   multiples of the high watermarks, up to +max_shift once that
+   reaches curse_adaptive_plenty.
+*/
+static int curse_adaptive_plenty = 8;
+static int curse_adaptive_max_shift = 6;
+static int curse_adaptive_min_shift = 4;
+static int curse_adaptive_shift;
+static unsigned long curse_adaptive_stamp;
+
+#define CURSE_WAVELENGTH_MAX (1U << 30)
+
+static int curse_adaptive_compute_shift(void) {
+    struct zone *zone;
+    unsigned long low = 0, high = 0, free, avail;
+    int min_shift = curse_adaptive_min_shift;
+    int max_shift = curse_adaptive_max_shift;
+    int plenty = curse_adaptive_plenty;
+
+    for_each_populated_zone(zone) {
+        low += low_wmark_pages(zone);
+        high += high_wmark_pages(zone);
+    }
+    free = global_page_state(NR_FREE_PAGES);
+    if (free < low || high == 0) {
+        return -min_shift;
+    }
+
+    /* in 64 bits: the watermarks times plenty overflow a 32-bit long
+       on machines with a few GB of highmem
+    */
+    avail = free + global_page_state(NR_INACTIVE_FILE);
+    if (avail >= (u64)high * plenty) {
+        return max_shift;
+    }
+    if (avail <= high) {
+        return -min_shift;
+    }
+    return -min_shift + (int)div64_u64((u64)(avail - high) * (min_shift + max_shift), (u64)high * (plenty - 1));
+}
+
+/* the wavelength the task's next checkpoint is held to */
+static unsigned int curse_nocache_wavelength(struct curse_state *cs) {
+    u64 wavelength = cs->params.nocache_wavelength;
+    int shift;
+
+    if (!(cs->params.nocache_flags & CURSE_NOCACHE_ADAPTIVE)) {
+        return wavelength;
+    }
+
+    /* the zone counters only need a fresh look once per tick */
+    if (curse_adaptive_stamp != jiffies) {
+        curse_adaptive_stamp = jiffies;
+        curse_adaptive_shift = curse_adaptive_compute_shift();
+    }
+    shift = curse_adaptive_shift;
+
+    if (shift >= 0) {
+        wavelength <<= shift;
+    }
+    else {
+        wavelength >>= -shift;
+    }
+    return clamp_t(u64, wavelength, 1, CURSE_WAVELENGTH_MAX);
+}
+
+static long curse_params_from_user(struct curse_params *params, void __user *addr) {
+    u32 size;
+
+    if (get_user(size, (u32 __user *)addr)) {
+        return -EFAULT;
+    }
+    if (size > sizeof(*params)) {
+        return -E2BIG;
+    }
+    if (size < CURSE_PARAMS_SIZE_VER0) {
+        return -EINVAL;
+    }
+
+    /* fields unknown to an older caller stay zero, and unset */
+    memset(params, 0, sizeof(*params));
+    if (copy_from_user(params, addr, size)) {
+        return -EFAULT;
+    }
+
+    if (params->set & ~CURSE_PARAM_ALL) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_NOCACHE_WAVELENGTH) && params->nocache_wavelength == 0) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_NOCACHE_MODE)
+            && params->nocache_mode != CURSE_NOCACHE_MODE_DROPBEHIND
+            && params->nocache_mode != CURSE_NOCACHE_MODE_WHOLEFILE) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_NOCACHE_FLAGS) && (params->nocache_flags & ~CURSE_NOCACHE_FLAGS_ALL)) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_NOCACHE_FAULT_WAVELENGTH) && params->nocache_fault_wavelength == 0) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_DIRTYLIMIT_PAGES) && params->dirtylimit_pages == 0) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_RECKLESS_MODE)
+            && params->reckless_mode != CURSE_RECKLESS_MODE_ASYNC
+            && params->reckless_mode != CURSE_RECKLESS_MODE_NOOP) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_STINK_FLAGS) && (params->stink_flags & ~CURSE_STINK_FLAGS_ALL)) {
+        return -EINVAL;
+    }
+    if ((params->set & CURSE_PARAM_CACHEQUOTA_PAGES) && params->cachequota_pages == 0) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/* apply the fields named in params->set; the hooks read each field
+   only once per call, so no lock is needed against them
+*/
+static void curse_params_apply(struct curse_state *cs, const struct curse_params *params) {
+    if (params->set & CURSE_PARAM_NOCACHE_WAVELENGTH) {
+        cs->params.nocache_wavelength = params->nocache_wavelength;
+    }
+    if (params->set & CURSE_PARAM_NOCACHE_MODE) {
+        cs->params.nocache_mode = params->nocache_mode;
+    }
+    if (params->set & CURSE_PARAM_NOCACHE_FLAGS) {
+        cs->params.nocache_flags = params->nocache_flags;
+    }
+    if (params->set & CURSE_PARAM_NOCACHE_BUDGET) {
+        cs->params.nocache_budget = params->nocache_budget;
+    }
+    if (params->set & CURSE_PARAM_NOCACHE_BACKLOG_MAX) {
+        cs->params.nocache_backlog_max = params->nocache_backlog_max;
+    }
+    if (params->set & CURSE_PARAM_NOCACHE_PERIOD) {
+        cs->params.nocache_period_ms = params->nocache_period_ms;
+    }
+    if (params->set & CURSE_PARAM_NOCACHE_FAULT_WAVELENGTH) {
+        cs->params.nocache_fault_wavelength = params->nocache_fault_wavelength;
+    }
+    if (params->set & CURSE_PARAM_DIRTYLIMIT_PAGES) {
+        cs->params.dirtylimit_pages = params->dirtylimit_pages;
+    }
+    if (params->set & CURSE_PARAM_RECKLESS_MODE) {
+        cs->params.reckless_mode = params->reckless_mode;
+    }
+    if (params->set & CURSE_PARAM_STINK_FLAGS) {
+        cs->params.stink_flags = params->stink_flags;
+    }
+    if (params->set & CURSE_PARAM_CACHEQUOTA_PAGES) {
+        cs->params.cachequota_pages = params->cachequota_pages;
+    }
+    if (params->set & CURSE_PARAM_THROTTLE_BPS) {
+        cs->params.throttle_bps = params->throttle_bps;
+    }
+    if (params->set & CURSE_PARAM_THROTTLE_IOPS) {
+        cs->params.throttle_iops = params->throttle_iops;
+    }
+}
+
+static long curse_params_to_user(const struct curse_params *params, void __user *addr) {
+    struct curse_params kparams = *params;
+    u32 size;
+
+    if (get_user(size, (u32 __user *)addr)) {
+        return -EFAULT;
+    }
+    if (size < CURSE_PARAMS_SIZE_VER0) {
+        return -EINVAL;
+    }
+
+    /* an older caller gets the fields it knows about */
+    kparams.size = sizeof(kparams);
+    kparams.set = CURSE_PARAM_ALL;
+    if (copy_to_user(addr, &kparams, min_t(u32, size, sizeof(kparams)))) {
+        return -EFAULT;
+    }
+    return 0;
+}
+
+static int curse_sysctl_zero = 0;
+static int curse_sysctl_one = 1;
+static int curse_sysctl_two = 2;
+static int curse_sysctl_plenty_max = 1024;
+static int curse_sysctl_shift_max = 16;
+static int curse_sysctl_mode_max = CURSE_NOCACHE_MODE_WHOLEFILE;
+static int curse_sysctl_flags_max = CURSE_NOCACHE_FLAGS_ALL;
+static int curse_sysctl_reckless_max = CURSE_RECKLESS_MODE_NOOP;
+static int curse_sysctl_stink_flags_max = CURSE_STINK_FLAGS_ALL;
+static int curse_sysctl_minus_one = -1;
+static int curse_sysctl_hundred = 100;
+static int curse_sysctl_auto_max = CURSE_AUTO_DEMOTE;
+
+/* turning automatic cursing on starts the scan; it stops by itself
+   once it is turned off
+*/
+static int curse_auto_sysctl_handler(ctl_table *table, int write, void __user *buffer, size_t *lenp, loff_t *ppos) {
+    int err;
+
+    mutex_lock(&curse_auto_mutex);
+    err = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+    if (err == 0 && write && curse_auto != CURSE_AUTO_OFF) {
+        queue_delayed_work(curse_wq, &curse_auto_work, msecs_to_jiffies(curse_auto_period_ms));
+    }
+    mutex_unlock(&curse_auto_mutex);
+    return err;
+}
+
+static int curse_auto_comm_handler(ctl_table *table, int write, void __user *buffer, size_t *lenp, loff_t *ppos) {
+    int err;
+
+    mutex_lock(&curse_auto_mutex);
+    err = proc_dostring(table, write, buffer, lenp, ppos);
+    mutex_unlock(&curse_auto_mutex);
+    return err;
+}
+
+static ctl_table curse_sysctl_table[] = {
+    {
+        .procname       = "nocache_wavelength",
+        .data           = &curse_default_params.nocache_wavelength,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_one,
+    },
+    {
+        .procname       = "nocache_mode",
+        .data           = &curse_default_params.nocache_mode,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_one,
+        .extra2         = &curse_sysctl_mode_max,
+    },
+    {
+        .procname       = "nocache_flags",
+        .data           = &curse_default_params.nocache_flags,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+        .extra2         = &curse_sysctl_flags_max,
+    },
+    {
+        .procname       = "nocache_budget",
+        .data           = &curse_default_params.nocache_budget,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+    },
+    {
+        .procname       = "nocache_backlog_max",
+        .data           = &curse_default_params.nocache_backlog_max,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+    },
+    {
+        .procname       = "nocache_period_ms",
+        .data           = &curse_default_params.nocache_period_ms,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+    },
+    {
+        .procname       = "nocache_fault_wavelength",
+        .data           = &curse_default_params.nocache_fault_wavelength,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_one,
+    },
+    {
+        .procname       = "dirtylimit_pages",
+        .data           = &curse_default_params.dirtylimit_pages,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_one,
+    },
+    {
+        .procname       = "reckless_mode",
+        .data           = &curse_default_params.reckless_mode,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_one,
+        .extra2         = &curse_sysctl_reckless_max,
+    },
+    {
+        .procname       = "stink_flags",
+        .data           = &curse_default_params.stink_flags,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+        .extra2         = &curse_sysctl_stink_flags_max,
+    },
+    {
+        .procname       = "cachequota_pages",
+        .data           = &curse_default_params.cachequota_pages,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_one,
+    },
+    {
+        .procname       = "throttle_bps",
+        .data           = &curse_default_params.throttle_bps,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+    },
+    {
+        .procname       = "throttle_iops",
+        .data           = &curse_default_params.throttle_iops,
+        .maxlen         = sizeof(unsigned int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+    },
+    {
+        .procname       = "auto_curse",
+        .data           = &curse_auto,
+        .maxlen         = sizeof(int),
+        .mode           = 0644,
+        .proc_handler   = curse_auto_sysctl_handler,
+        .extra1         = &curse_sysctl_zero,
+        .extra2         = &curse_sysctl_auto_max,
+    },
+    {
+        .procname       = "auto_curse_period_ms",
+        .data           = &curse_auto_period_ms,
+        .maxlen         = sizeof(int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_hundred,
+    },
+    {
+        .procname       = "auto_curse_rate_kb",
+        .data           = &curse_auto_rate_kb,
+        .maxlen         = sizeof(int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_one,
+    },
+    {
+        .procname       = "auto_curse_miss_pct",
+        .data           = &curse_auto_miss_pct,
+        .maxlen         = sizeof(int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+        .extra2         = &curse_sysctl_hundred,
+    },
+    {
+        .procname       = "auto_curse_exempt_uids",
+        .data           = &curse_auto_exempt_uids,
+        .maxlen         = sizeof(curse_auto_exempt_uids),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_minus_one,
+    },
+    {
+        .procname       = "auto_curse_exempt_comm",
+        .data           = curse_auto_exempt_comm,
+        .maxlen         = CURSE_AUTO_COMM_LEN,
+        .mode           = 0644,
+        .proc_handler   = curse_auto_comm_handler,
+    },
+    {
+        .procname       = "auto_curse_casts",
+        .data           = &curse_auto_casts,
+        .maxlen         = sizeof(unsigned long),
+        .mode           = 0444,
+        .proc_handler   = proc_doulongvec_minmax,
+    },
+    {
+        .procname       = "nocache_adaptive_plenty",
+        .data           = &curse_adaptive_plenty,
+        .maxlen         = sizeof(int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_two,
+        .extra2         = &curse_sysctl_plenty_max,
+    },
+    {
+        .procname       = "nocache_adaptive_max_shift",
+        .data           = &curse_adaptive_max_shift,
+        .maxlen         = sizeof(int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+        .extra2         = &curse_sysctl_shift_max,
+    },
+    {
+        .procname       = "nocache_adaptive_min_shift",
+        .data           = &curse_adaptive_min_shift,
+        .maxlen         = sizeof(int),
+        .mode           = 0644,
+        .proc_handler   = proc_dointvec_minmax,
+        .extra1         = &curse_sysctl_zero,
+        .extra2         = &curse_sysctl_shift_max,
+    },
+    {
+        .procname       = "nocache_adaptive_shift",
+        .data           = &curse_adaptive_shift,
+        .maxlen         = sizeof(int),
+        .mode           = 0444,
+        .proc_handler   = proc_dointvec,
+    },
+    { }
+};
+
+static struct ctl_path curse_sysctl_path[] = {
+    { .procname = "kernel", },
+    { .procname = "curse", },
+    { }
+};
+
+static int __init curse_sysctl_init(void) {
+    register_sysctl_paths(curse_sysctl_path, curse_sysctl_table);
+    return 0;
 }
+late_initcall(curse_sysctl_init);
 
 static long authorize_curse(struct task_struct *target_task) {
     const struct cred *own_creds, *target_creds;
@@ -122,20 +857,18 @@ static long authorize_curse(struct task_struct *target_task) {
 
 static long curse_read_by_pid(unsigned int curse_index, pid_t pid) {
     struct task_struct *target_task;
+    struct curse_state *cs;
     long err;
 
-    /* get the global tasklist lock for two reasons:
-       1. be extra safe to protect our searching tasks against the rest of the kernel
-       2. protect our reading the curses against ourselves setting the curses.
-          This could be done with a per-task lock,
-          but get/set curses is not performance critical
-          and we are holding a big lock anyway.
-    */
-    read_lock_irq(&tasklist_lock);
-
     /* validate input */
-    err = -EINVAL;
-    if (pid <= 0) goto out;
+    if (pid <= 0) return -EINVAL;
+
+    /* the pid lookup only needs RCU: the task_struct cannot be freed
+       while we are inside the read-side critical section, and the
+       curse bits themselves are manipulated with atomic bitops,
+       so there is no need for tasklist_lock here
+    */
+    rcu_read_lock();
 
     err = -ESRCH;
     target_task = find_task_by_vpid(pid);
@@ -144,59 +877,123 @@ static long curse_read_by_pid(unsigned int curse_index, pid_t pid) {
     err = authorize_curse(target_task);
     if (err) goto out;
 
-    err = (target_task->curses & (1 << curse_index)) > 0;
+    /* a task that was never cursed has no state at all */
+    cs = ACCESS_ONCE(target_task->curse);
+    err = cs != NULL && test_bit(curse_index, &cs->curses);
 
 out:
-    read_unlock_irq(&tasklist_lock);
+    rcu_read_unlock();
     return err;
 }
 
-static long curse_modify_by_pid(unsigned int curse_index, pid_t pid, int enable) {
+/* cast a curse on a pinned task, applying params first unless they
+   are NULL; casting a curse the task already bears only changes them
+*/
+static long curse_cast(struct task_struct *target_task, unsigned int curse_index, const struct curse_params *params) {
+    struct curse_state *cs;
+
+    if (curse_global_status(curse_index) == 0) {
+        return -EINVAL;
+    }
+    cs = curse_state_get(target_task);
+    if (cs == NULL) {
+        return -ENOMEM;
+    }
+    if (params != NULL) {
+        curse_params_apply(cs, params);
+    }
+    if (!test_and_set_bit(curse_index, &cs->curses)) {
+        if (curses_enable_list[curse_index] != NULL) {
+            (*(curses_enable_list[curse_index]))(target_task);
+        }
+    }
+    return 0;
+}
+
+static long curse_modify_by_pid(unsigned int curse_index, pid_t pid, int enable, void __user *addr) {
     struct task_struct *target_task;
+    struct curse_state *cs;
+    struct curse_params params;
     long err;
 
-    write_lock_irq(&tasklist_lock);
-
     /* validate input */
-    err = -EINVAL;
-    if (pid <= 0) goto out;
+    if (pid <= 0) return -EINVAL;
+    if (enable && addr != NULL) {
+        err = curse_params_from_user(&params, addr);
+        if (err) return err;
+    }
 
-    err = -ESRCH;
+    /* pin the target so that the curse handlers may sleep */
+    rcu_read_lock();
     target_task = find_task_by_vpid(pid);
-    if (!target_task) goto out;
+    if (target_task) {
+        get_task_struct(target_task);
+    }
+    rcu_read_unlock();
+
+    if (!target_task) return -ESRCH;
 
     err = authorize_curse(target_task);
     if (err) goto out;
 
     if (enable) {
-        if (curse_global_status(curse_index) == 0) {
-            err = -EINVAL;
-        }
-        else {
-            target_task->curses |= (1 << curse_index);
-            if (curses_enable_list[curse_index] != NULL) {
-                (*(curses_enable_list[curse_index]))(pid);
-            }
-        }
+        err = curse_cast(target_task, curse_index, addr != NULL ? &params : NULL);
+        if (err) goto out;
     }
     else {
-        target_task->curses &= ~(1 << curse_index);
-        if (curses_disable_list[curse_index] != NULL) {
-            (*(curses_disable_list[curse_index]))(pid);
+        cs = ACCESS_ONCE(target_task->curse);
+        if (cs != NULL && test_and_clear_bit(curse_index, &cs->curses)) {
+            if (curses_disable_list[curse_index] != NULL) {
+                (*(curses_disable_list[curse_index]))(target_task);
+            }
         }
     }
 
     err = 0;
 
 out:
-    write_unlock_irq(&tasklist_lock);
+    put_task_struct(target_task);
     return err;
 }
 
+static long curse_params_by_pid(pid_t pid, void __user *addr) {
+    struct task_struct *target_task;
+    struct curse_state *cs;
+    struct curse_params params;
+    long err;
+
+    /* validate input */
+    if (pid <= 0) return -EINVAL;
+
+    rcu_read_lock();
+
+    err = -ESRCH;
+    target_task = find_task_by_vpid(pid);
+    if (!target_task) goto out;
+
+    err = authorize_curse(target_task);
+    if (err) goto out;
+
+    /* a task that was never cursed would get the defaults */
+    cs = ACCESS_ONCE(target_task->curse);
+    params = cs != NULL ? cs->params : curse_default_params;
+
+out:
+    rcu_read_unlock();
+    if (err) return err;
+
+    return curse_params_to_user(&params, addr);
+}
+
 int curse_get_list(void* __user addr) {
     int SIZE = (MAX_NAME_LIST_NAME_LEN + 1) * MAX_NUM_CURSES + 1;
-    char* buffer = (char*)kmalloc(SIZE);
+    char* buffer = kmalloc(SIZE, GFP_KERNEL);
     int i, last = 0;
+    int err = 0;
+
+    if (buffer == NULL) {
+        return -ENOMEM;
+    }
 
     for (i = 0; i < curses_names.nr_names; ++i) {
         strcpy(buffer + last, curses_names.names[i]);
@@ -205,19 +1002,273 @@ int curse_get_list(void* __user addr) {
         ++last;
     }
     buffer[last] = '\0';
-    if (copy_to_user(addr, buffer, SIZE)) {
-        return -EFAULT;
+    if (copy_to_user(addr, buffer, last + 1)) {
+        err = -EFAULT;
+    }
+    kfree(buffer);
+    return err;
+}
+
+/* ************************** */
+/*     Automatic Cursing      */
+/* ************************** */
+
+/* With auto_curse set, a scan runs every auto_curse_period_ms and
+   curses the tasks that pollute the page cache: those that have kept
+   moving more than auto_curse_rate_kb KB/s from or to storage, with
+   at least auto_curse_miss_pct percent of the bytes they read or
+   wrote through system calls missing the cache. A task that keeps
+   rereading cached data is doing the cache's job, a streaming one is
+   not. Rates are moving averages over about four periods, so a burst
+   alone does not get a task cursed.
+   The curse cast is nocache with the default parameters, or with
+   auto_curse set to 2 nocache that only demotes the task's pages to
+   the tail of the LRU (CURSE_NOCACHE_DEMOTE); it has to be globally
+   enabled; kernel threads,
+   tasks of the uids in auto_curse_exempt_uids and those named in
+   auto_curse_exempt_comm are never cursed. Every cast is logged and
+   counted in auto_curse_casts. Storage I/O is only known with
+   CONFIG_TASK_IO_ACCOUNTING; without it nobody is ever cursed.
+*/
+
+#define CURSE_AUTO_TASKS_MAX 128
+/* casts per scan, the rest wait for the next one */
+#define CURSE_AUTO_CAST_MAX 8
+#define CURSE_AUTO_EWMA_SHIFT 2
+/* the scan looks every task up by pid, in a hash of this many bits */
+#define CURSE_AUTO_HASH_BITS 6
+
+/* a task the scan keeps an eye on */
+struct curse_auto_task {
+    struct hlist_node node;             /* in the pid hash, or free */
+    pid_t pid;                          /* 0 for a free slot */
+    struct timespec start_time;         /* tells a reused pid apart */
+    u64 io;                             /* the counters at the last scan */
+    u64 chars;
+    unsigned long io_rate;              /* KB/s, moving averages */
+    unsigned long chars_rate;
+    unsigned int pass;                  /* the last scan that saw the task */
+};
+
+/* only ever touched by the scan */
+static struct curse_auto_task curse_auto_tasks[CURSE_AUTO_TASKS_MAX];
+static struct hlist_head curse_auto_hash[1 << CURSE_AUTO_HASH_BITS];
+static struct hlist_head curse_auto_free;
+static unsigned int curse_auto_pass;
+static unsigned long curse_auto_stamp;
+
+/* storage I/O and system call I/O of a task so far, in bytes */
+static void curse_auto_io(struct task_struct *p, u64 *io, u64 *chars) {
+    *io = *chars = 0;
+#ifdef CONFIG_TASK_IO_ACCOUNTING
+    *io = p->ioac.read_bytes + p->ioac.write_bytes;
+#endif
+#ifdef CONFIG_TASK_XACCT
+    *chars = p->ioac.rchar + p->ioac.wchar;
+#endif
+}
+
+/* forget every task, all slots are free */
+static void curse_auto_reset(void) {
+    unsigned int i;
+
+    memset(curse_auto_tasks, 0, sizeof(curse_auto_tasks));
+    for (i = 0; i < ARRAY_SIZE(curse_auto_hash); ++i) {
+        INIT_HLIST_HEAD(&curse_auto_hash[i]);
+    }
+    INIT_HLIST_HEAD(&curse_auto_free);
+    for (i = 0; i < CURSE_AUTO_TASKS_MAX; ++i) {
+        hlist_add_head(&curse_auto_tasks[i].node, &curse_auto_free);
+    }
+}
+
+static struct curse_auto_task *curse_auto_find(struct task_struct *p) {
+    struct curse_auto_task *at;
+    struct hlist_node *pos;
+
+    hlist_for_each_entry(at, pos, &curse_auto_hash[hash_long(p->pid, CURSE_AUTO_HASH_BITS)], node) {
+        if (at->pid == p->pid && timespec_equal(&at->start_time, &p->start_time)) {
+            return at;
+        }
+    }
+    return NULL;
+}
+
+/* start watching p, in a free slot or else in the one of the quietest
+   task; only when all slots are taken does this walk them
+*/
+static struct curse_auto_task *curse_auto_add(struct task_struct *p) {
+    struct curse_auto_task *at = &curse_auto_tasks[0];
+    unsigned int i;
+
+    if (!hlist_empty(&curse_auto_free)) {
+        at = hlist_entry(curse_auto_free.first, struct curse_auto_task, node);
+    }
+    else {
+        for (i = 0; i < CURSE_AUTO_TASKS_MAX; ++i) {
+            if (curse_auto_tasks[i].io_rate < at->io_rate) {
+                at = &curse_auto_tasks[i];
+            }
+        }
+    }
+    hlist_del(&at->node);
+    at->pid = p->pid;
+    at->start_time = p->start_time;
+    hlist_add_head(&at->node, &curse_auto_hash[hash_long(p->pid, CURSE_AUTO_HASH_BITS)]);
+    return at;
+}
+
+static void curse_auto_forget(struct curse_auto_task *at) {
+    hlist_del(&at->node);
+    at->pid = 0;
+    hlist_add_head(&at->node, &curse_auto_free);
+}
+
+/* whether name is in a list of names separated by spaces or commas */
+static int curse_auto_comm_listed(const char *list, const char *name) {
+    size_t len = strlen(name), n;
+
+    while (*list != '\0') {
+        list += strspn(list, " ,\n");
+        n = strcspn(list, " ,\n");
+        if (n == len && strncmp(list, name, len) == 0) {
+            return 1;
+        }
+        list += n;
     }
     return 0;
 }
 
+/* called under RCU */
+static int curse_auto_exempt(struct task_struct *p, const char *comm_list) {
+    uid_t uid = __task_cred(p)->uid;
+    unsigned int i;
+
+    for (i = 0; i < CURSE_AUTO_UIDS_MAX; ++i) {
+        if (curse_auto_exempt_uids[i] >= 0 && curse_auto_exempt_uids[i] == uid) {
+            return 1;
+        }
+    }
+    return curse_auto_comm_listed(comm_list, p->comm);
+}
+
+static void curse_auto_scan(struct work_struct *work) {
+    static char comm_list[CURSE_AUTO_COMM_LEN];
+    struct task_struct *cast[CURSE_AUTO_CAST_MAX];
+    unsigned long rates[CURSE_AUTO_CAST_MAX];
+    struct task_struct *g, *p;
+    struct curse_auto_task *at;
+    struct curse_state *cs;
+    struct curse_params params, *cast_params = NULL;
+    unsigned int i, nr = 0;
+    unsigned long elapsed, floor, rate_kb;
+    u64 io, chars;
+
+    mutex_lock(&curse_auto_mutex);
+    if (curse_auto == CURSE_AUTO_OFF) {
+        mutex_unlock(&curse_auto_mutex);
+        return;
+    }
+    if (curse_auto == CURSE_AUTO_DEMOTE) {
+        memset(&params, 0, sizeof(params));
+        params.size = sizeof(params);
+        params.set = CURSE_PARAM_NOCACHE_FLAGS;
+        params.nocache_flags = curse_default_params.nocache_flags | CURSE_NOCACHE_DEMOTE;
+        cast_params = &params;
+    }
+    rate_kb = curse_auto_rate_kb;
+    memcpy(comm_list, curse_auto_exempt_comm, sizeof(comm_list));
+    comm_list[sizeof(comm_list) - 1] = '\0';
+
+    elapsed = jiffies_to_msecs(jiffies - curse_auto_stamp);
+    curse_auto_stamp = jiffies;
+    ++curse_auto_pass;
+    if (curse_auto_pass == 1 || elapsed == 0 || elapsed > 4 * (unsigned long)curse_auto_period_ms) {
+        /* the first scan, or the first in a long while: start over */
+        curse_auto_reset();
+        elapsed = 0;
+    }
+    /* a task that has not moved this much in all its life need not be watched */
+    floor = rate_kb * curse_auto_period_ms / 1000;
+
+    rcu_read_lock();
+    do_each_thread(g, p) {
+        if ((p->flags & PF_KTHREAD) || p->mm == NULL) {
+            continue;
+        }
+        cs = p->curse;
+        if (cs != NULL && test_bit(CURSE_NOCACHE, &cs->curses)) {
+            continue;
+        }
+        curse_auto_io(p, &io, &chars);
+        at = curse_auto_find(p);
+        if (at == NULL) {
+            if ((io >> 10) < floor) {
+                continue;
+            }
+            at = curse_auto_add(p);
+            at->io = io;
+            at->chars = chars;
+            at->io_rate = at->chars_rate = 0;
+            at->pass = curse_auto_pass;
+            continue;
+        }
+        at->pass = curse_auto_pass;
+        if (elapsed > 0) {
+            at->io_rate -= at->io_rate >> CURSE_AUTO_EWMA_SHIFT;
+            at->io_rate += ((unsigned long)((io - at->io) >> 10) * 1000 / elapsed) >> CURSE_AUTO_EWMA_SHIFT;
+            at->chars_rate -= at->chars_rate >> CURSE_AUTO_EWMA_SHIFT;
+            at->chars_rate += ((unsigned long)((chars - at->chars) >> 10) * 1000 / elapsed) >> CURSE_AUTO_EWMA_SHIFT;
+        }
+        at->io = io;
+        at->chars = chars;
+
+        if (at->io_rate < rate_kb || nr == CURSE_AUTO_CAST_MAX) {
+            continue;
+        }
+#ifdef CONFIG_TASK_XACCT
+        if (at->io_rate * 100 < (unsigned long)curse_auto_miss_pct * at->chars_rate) {
+            continue;
+        }
+#endif
+        if (curse_auto_exempt(p, comm_list)) {
+            continue;
+        }
+        get_task_struct(p);
+        rates[nr] = at->io_rate;
+        cast[nr++] = p;
+        curse_auto_forget(at);
+    } while_each_thread(g, p);
+    rcu_read_unlock();
+
+    /* forget the tasks that have exited */
+    for (i = 0; i < CURSE_AUTO_TASKS_MAX; ++i) {
+        if (curse_auto_tasks[i].pid != 0 && curse_auto_tasks[i].pass != curse_auto_pass) {
+            curse_auto_forget(&curse_auto_tasks[i]);
+        }
+    }
+
+    /* casting may sleep */
+    for (i = 0; i < nr; ++i) {
+        if (curse_cast(cast[i], CURSE_NOCACHE, cast_params) == 0) {
+            ++curse_auto_casts;
+            printk(KERN_NOTICE "curse: %s[%d] moves %lu KB/s past the page cache, cursed with nocache%s\n",
+                   cast[i]->comm, task_pid_nr(cast[i]), rates[i], cast_params != NULL ? " (demote)" : "");
+        }
+        put_task_struct(cast[i]);
+    }
+
+    queue_delayed_work(curse_wq, &curse_auto_work, msecs_to_jiffies(curse_auto_period_ms));
+    mutex_unlock(&curse_auto_mutex);
+}
+
 /* ************************** */
 /*      Curse System Call     */
 /* ************************** */
 
 asmlinkage long sys_curse(long call, curse_id_t curse_id, pid_t pid, void* addr)
 {
-    unsigned int curse_index;
+    int curse_index;
     long r = -EINVAL;
 
     printk(KERN_DEBUG "sys_curse system call.\n");
@@ -231,7 +1282,8 @@ asmlinkage long sys_curse(long call, curse_id_t curse_id, pid_t pid, void* addr)
     case CURSE_CMD_CURSE_GLOBAL_STATUS:
          /* report curse status (enabled/disabled) */
          curse_index = curse_index_from_id(curse_id);
-         if (curse_index == -1) {
+         if (curse_index < 0) {
+             r = curse_index;
              break;
          }
          r = curse_global_status(curse_index);
@@ -239,23 +1291,26 @@ asmlinkage long sys_curse(long call, curse_id_t curse_id, pid_t pid, void* addr)
 
     case CURSE_CMD_CURSE_GLOBAL_ENABLE:
          curse_index = curse_index_from_id(curse_id);
-         if (curse_index == -1) {
+         if (curse_index < 0) {
+             r = curse_index;
              break;
          }
-         r = curse_global_enable(curse_index_from_id(curse_id));
+         r = curse_global_enable(curse_index);
          break;
 
     case CURSE_CMD_CURSE_GLOBAL_DISABLE:
          curse_index = curse_index_from_id(curse_id);
-         if (curse_index == -1) {
+         if (curse_index < 0) {
+             r = curse_index;
              break;
          }
-         r = curse_global_disable(curse_index_from_id(curse_id));
+         r = curse_global_disable(curse_index);
          break;
 
     case CURSE_CMD_CURSE_STATUS:
          curse_index = curse_index_from_id(curse_id);
-         if (curse_index == -1) {
+         if (curse_index < 0) {
+             r = curse_index;
              break;
          }
          /* report curse status of process */
@@ -265,20 +1320,27 @@ asmlinkage long sys_curse(long call, curse_id_t curse_id, pid_t pid, void* addr)
     case CURSE_CMD_CURSE_CAST:
          printk(KERN_DEBUG "Casting curse upon process with id = %i.\n", pid);
          curse_index = curse_index_from_id(curse_id);
-         if (curse_index == -1) {
+         if (curse_index < 0) {
+             r = curse_index;
              break;
          }
          /* cast a curse */
-         r = curse_modify_by_pid(curse_index, pid, 1);
+         r = curse_modify_by_pid(curse_index, pid, 1, addr);
          break;
 
     case CURSE_CMD_CURSE_LIFT:
          curse_index = curse_index_from_id(curse_id);
-         if (curse_index == -1) {
+         if (curse_index < 0) {
+             r = curse_index;
              break;
          }
          /* lift a curse */
-         r = curse_modify_by_pid(curse_index, pid, 0);
+         r = curse_modify_by_pid(curse_index, pid, 0, NULL);
+         break;
+
+    case CURSE_CMD_CURSE_GET_PARAMS:
+         /* report the curse parameters of process */
+         r = curse_params_by_pid(pid, addr);
          break;
 
     default:
@@ -293,56 +1355,1734 @@ asmlinkage long sys_curse(long call, curse_id_t curse_id, pid_t pid, void* addr)
 /*  NOCACHE Curse Implementation  */
 /* ****************************** */
 
-int curse_nocache_vanish(pid_t pid) {
-    int i, err;
-    struct fdtable *files_table;
+/* pipes, sockets and the like have no page cache */
+static int curse_file_cacheable(struct file *file) {
+    umode_t mode = file->f_path.dentry->d_inode->i_mode;
 
-    files_table = files_fdtable(current->files);
-    i = 0;
-    while (files_table->fd[i] != NULL) {
-        err = sys_fadvise64_64(i, 0, 0, POSIX_FADV_DONTNEED);
-        if (err < 0) {
-            return err;
-        }
-        ++i;
-    }
-    return 0;
+    return S_ISREG(mode) || S_ISBLK(mode);
 }
 
-static long curse_nocache_enable(pid_t pid) {
-    write_lock_irq(&tasklist_lock);
+/* the page cache behind a file, or NULL if there is nothing to drop */
+static struct address_space *curse_file_mapping(struct file *file) {
+    struct address_space *mapping = file->f_mapping;
 
-    printk(KERN_INFO "curse_nocache_enable\n");
-
-    current->curse_fs_no_cache_cnt = 0;
-
-    curse_nocache_vanish(pid);
+    if (!curse_file_cacheable(file)) {
+        return NULL;
+    }
+    if (mapping == NULL || mapping->nrpages == 0) {
+        return NULL;
+    }
+    return mapping;
+}
 
-    write_unlock_irq(&tasklist_lock);
+static void curse_inode_id_set(struct curse_inode_id *id, struct inode *inode) {
+    id->dev = inode->i_sb->s_dev;
+    id->ino = inode->i_ino;
+    id->generation = inode->i_generation;
+}
 
-    return 0;
+static int curse_inode_id_eq(const struct curse_inode_id *a, const struct curse_inode_id *b) {
+    return a->ino == b->ino && a->dev == b->dev && a->generation == b->generation;
 }
 
-static long curse_nocache_disable(pid_t pid) {
+/* the soft alternative to invalidation, for CURSE_NOCACHE_DEMOTE:
+   the pages stay cached, but become the first ones reclaim takes.
+   Clean inactive pages move to the tail of the inactive list, active
+   ones lose their referenced bit so that the next scan of the active
+   list deactivates them, and dirty ones are rotated by
+   end_page_writeback() once written. Pages mapped by anybody are
+   somebody's working set and stay where they are.
+   Returns the number of pages demoted.
+*/
+static unsigned long curse_nocache_demote(struct address_space *mapping, pgoff_t start, pgoff_t end) {
+    struct pagevec pvec;
+    struct page *page;
+    pgoff_t index = start, next = start;
+    unsigned long demoted = 0;
+    unsigned int i;
+
+    pagevec_init(&pvec, 0);
+    while (next <= end && pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
+        for (i = 0; i < pagevec_count(&pvec); ++i) {
+            page = pvec.pages[i];
+            /* pinned by the lookup, ->index cannot change under us */
+            index = page->index;
+            if (index > end) {
+                break;
+            }
+            if (index > next) {
+                next = index;
+            }
+            ++next;
+
+            if (page_mapped(page)) {
+                continue;
+            }
+            ClearPageReferenced(page);
+            if (PageDirty(page) || PageWriteback(page)) {
+                SetPageReclaim(page);
+            }
+            else {
+                rotate_reclaimable_page(page);
+            }
+            ++demoted;
+        }
+        pagevec_release(&pvec);
+        cond_resched();
+        /* done, or wrapped past ~0UL */
+        if (index >= end || next == 0) {
+            break;
+        }
+    }
+    return demoted;
+}
+
+/* the POSIX_FADV_DONTNEED work on pages start to end inclusive,
+   without going through the syscall: kick off writeback so that dirty
+   pages can be dropped by a later vanish, then invalidate everything
+   that is clean and unmapped, or with CURSE_NOCACHE_DEMOTE only
+   demote it
+*/
+static unsigned long curse_nocache_evict_range(struct address_space *mapping, pgoff_t start, pgoff_t end, unsigned int flags) {
+    loff_t lstart = (loff_t)start << PAGE_CACHE_SHIFT;
+    loff_t lend = LLONG_MAX;
+
+    if (end != ~0UL) {
+        lend = ((loff_t)(end + 1) << PAGE_CACHE_SHIFT) - 1;
+    }
+    if (!bdi_write_congested(mapping->backing_dev_info)) {
+        __filemap_fdatawrite_range(mapping, lstart, lend, WB_SYNC_NONE);
+    }
+    if (flags & CURSE_NOCACHE_DEMOTE) {
+        return curse_nocache_demote(mapping, start, end);
+    }
+    return invalidate_mapping_pages(mapping, start, end);
+}
+
+/* whether any page from start to end inclusive is dirty or under writeback */
+static int curse_nocache_range_busy(struct address_space *mapping, pgoff_t start, pgoff_t end) {
+    static const int tags[] = { PAGECACHE_TAG_DIRTY, PAGECACHE_TAG_WRITEBACK };
+    struct pagevec pvec;
+    pgoff_t index;
+    unsigned int i;
+    int busy = 0;
+
+    for (i = 0; i < ARRAY_SIZE(tags) && !busy; ++i) {
+        index = start;
+        pagevec_init(&pvec, 0);
+        if (pagevec_lookup_tag(&pvec, mapping, &index, tags[i], 1)) {
+            busy = pvec.pages[0]->index <= end;
+            pagevec_release(&pvec);
+        }
+    }
+    return busy;
+}
+
+/* CURSE_NOCACHE_OWNED: the task only answers for the pages it brought
+   into the page cache itself. Those are recorded as extents while
+   they are inserted, and eviction is limited to them; pages that were
+   cached before the task came along are somebody else's and stay.
+   The task's own accesses to the pages it streams through do not
+   count (see __curse_page_accessed()), so a page of its extents that
+   is referenced or active has been used since it was brought in, by
+   another task or by the task's own random access, and stays as well.
+   Extents name their inode rather than point to its mapping, so that
+   one left behind by an evicted inode never matches the mapping of
+   another inode allocated at the same address.
+   When the table is full the oldest extent is forgotten, and its
+   pages are left to reclaim. That also recycles extents of inodes
+   that are gone by now.
+*/
+
+static int curse_nocache_owns(struct curse_state *cs) {
+    return test_bit(CURSE_NOCACHE, &cs->curses) && curse_global_status(CURSE_NOCACHE)
+        && (cs->params.nocache_flags & CURSE_NOCACHE_OWNED);
+}
+
+/* called under lock */
+static void curse_nocache_extent_add(struct curse_state *cs, const struct curse_inode_id *id, pgoff_t start, pgoff_t end) {
+    struct curse_extent *e;
+
+    if (cs->nocache_nr_owned == CURSE_NOCACHE_EXTENTS_MAX) {
+        memmove(&cs->nocache_owned[0], &cs->nocache_owned[1],
+                (CURSE_NOCACHE_EXTENTS_MAX - 1) * sizeof(cs->nocache_owned[0]));
+        --cs->nocache_nr_owned;
+    }
+    e = &cs->nocache_owned[cs->nocache_nr_owned++];
+    e->id = *id;
+    e->start = start;
+    e->end = end;
+}
+
+/* a page the task brought into the page cache */
+static void curse_nocache_own(struct curse_state *cs, struct page *page) {
+    pgoff_t index = page->index;
+    struct curse_inode_id id;
+    struct curse_extent *e;
+    unsigned int i;
+
+    /* tmpfs and shmem pages are the only copy of their data and cannot
+       be dropped; recording them would only push real extents out
+    */
+    if (PageSwapBacked(page)) {
+        return;
+    }
+    curse_inode_id_set(&id, page->mapping->host);
+
+    spin_lock(&cs->lock);
+    /* newest first, readahead mostly extends the last extent */
+    for (i = cs->nocache_nr_owned; i-- > 0; ) {
+        e = &cs->nocache_owned[i];
+        if (curse_inode_id_eq(&e->id, &id)
+                && (index >= e->start || index + 1 == e->start)
+                && (index <= e->end || index == e->end + 1)) {
+            e->start = min(e->start, index);
+            e->end = max(e->end, index);
+            goto out;
+        }
+    }
+    curse_nocache_extent_add(cs, &id, index, index);
+out:
+    spin_unlock(&cs->lock);
+}
+
+/* the first pages from start to end inclusive that the task owns,
+   *first to *last. Returns 0 if it owns none.
+*/
+static int curse_nocache_owned_next(struct curse_state *cs, struct address_space *mapping, pgoff_t start, pgoff_t end,
+                                    pgoff_t *first, pgoff_t *last) {
+    struct curse_inode_id id;
+    struct curse_extent *e;
+    unsigned int i;
+    int found = 0;
+
+    curse_inode_id_set(&id, mapping->host);
+    spin_lock(&cs->lock);
+    for (i = 0; i < cs->nocache_nr_owned; ++i) {
+        e = &cs->nocache_owned[i];
+        if (!curse_inode_id_eq(&e->id, &id) || e->end < start || e->start > end) {
+            continue;
+        }
+        if (!found || max(e->start, start) < *first) {
+            *first = max(e->start, start);
+            *last = min(e->end, end);
+            found = 1;
+        }
+    }
+    spin_unlock(&cs->lock);
+    return found;
+}
+
+/* the task no longer answers for pages start to end inclusive. An
+   extent cut in two loses its tail if the table is full.
+*/
+static void curse_nocache_disown(struct curse_state *cs, struct address_space *mapping, pgoff_t start, pgoff_t end) {
+    struct curse_inode_id id;
+    struct curse_extent *e;
+    unsigned int i = 0;
+    pgoff_t tail;
+
+    curse_inode_id_set(&id, mapping->host);
+    spin_lock(&cs->lock);
+    while (i < cs->nocache_nr_owned) {
+        e = &cs->nocache_owned[i];
+        if (!curse_inode_id_eq(&e->id, &id) || e->end < start || e->start > end) {
+            ++i;
+            continue;
+        }
+        if (e->start >= start && e->end <= end) {
+            /* keep the rest in age order */
+            memmove(e, e + 1, (cs->nocache_nr_owned - i - 1) * sizeof(*e));
+            --cs->nocache_nr_owned;
+            continue;
+        }
+        if (e->start >= start) {
+            e->start = end + 1;
+        }
+        else if (e->end <= end) {
+            e->end = start - 1;
+        }
+        else {
+            tail = e->end;
+            e->end = start - 1;
+            if (cs->nocache_nr_owned < CURSE_NOCACHE_EXTENTS_MAX) {
+                curse_nocache_extent_add(cs, &id, end + 1, tail);
+            }
+        }
+        ++i;
+    }
+    spin_unlock(&cs->lock);
+}
+
+/* evict pages start to end inclusive, all of them owned by the task,
+   but for those another task has used since. Page references keep
+   pages from being invalidated, so each run of evictable pages goes
+   only once the lookup has let go of them.
+*/
+static unsigned long curse_nocache_evict_run(struct curse_state *cs, struct address_space *mapping, pgoff_t start, pgoff_t end,
+                                             unsigned int flags) {
+    struct pagevec pvec;
+    struct page *page;
+    pgoff_t index = start, next = start, run = start;
+    unsigned long evicted = 0, spared = 0;
+    unsigned int i;
+    int used, done = 0;
+
+    pagevec_init(&pvec, 0);
+    while (!done && pagevec_lookup(&pvec, mapping, next, PAGEVEC_SIZE)) {
+        used = 0;
+        for (i = 0; i < pagevec_count(&pvec) && !used; ++i) {
+            page = pvec.pages[i];
+            index = page->index;
+            if (index > end) {
+                done = 1;
+                break;
+            }
+            next = index + 1;
+            used = PageReferenced(page) || PageActive(page);
+        }
+        pagevec_release(&pvec);
+        if (used) {
+            ++spared;
+            if (index > run) {
+                evicted += curse_nocache_evict_range(mapping, run, index - 1, flags);
+            }
+            run = next;
+        }
+        /* done, or wrapped past ~0UL */
+        done |= next > end || next == 0;
+        cond_resched();
+    }
+    if (run <= end && run >= start) {
+        evicted += curse_nocache_evict_range(mapping, run, end, flags);
+    }
+    atomic_long_add(spared, &cs->nocache_spared);
+    return evicted;
+}
+
+/* pages start to end inclusive that the task owns, run by run. Runs
+   still dirty or under writeback in write-behind mode stay owned, for
+   the next pass to drop once written.
+*/
+static unsigned long curse_nocache_evict_owned(struct curse_state *cs, struct address_space *mapping, pgoff_t start, pgoff_t end,
+                                               unsigned int flags) {
+    pgoff_t first, last;
+    unsigned long evicted = 0;
+
+    while (curse_nocache_owned_next(cs, mapping, start, end, &first, &last)) {
+        evicted += curse_nocache_evict_run(cs, mapping, first, last, flags);
+        if (!(flags & CURSE_NOCACHE_WRITEBEHIND) || !curse_nocache_range_busy(mapping, first, last)) {
+            curse_nocache_disown(cs, mapping, first, last);
+        }
+        if (last >= end) {
+            break;
+        }
+        start = last + 1;
+    }
+    return evicted;
+}
+
+static unsigned long curse_nocache_evict(struct curse_state *cs, struct address_space *mapping, pgoff_t start, pgoff_t end,
+                                         unsigned int flags) {
+    if (flags & CURSE_NOCACHE_OWNED) {
+        return curse_nocache_evict_owned(cs, mapping, start, end, flags);
+    }
+    return curse_nocache_evict_range(mapping, start, end, flags);
+}
+
+/* drop the page cache of every file the task has open.
+   Walks the open_fds bitmap rather than the fd array, so holes left
+   by closed descriptors do not end the walk early.
+*/
+static long curse_nocache_vanish(struct task_struct *tsk) {
+    struct files_struct *files;
+    struct fdtable *fdt;
+    struct address_space *mapping;
+    struct file *file;
+    unsigned int fd = 0;
+    long evicted = 0;
+
+    files = get_files_struct(tsk);
+    if (files == NULL) {
+        return 0;
+    }
+
+    rcu_read_lock();
+    fdt = files_fdtable(files);
+    for (;;) {
+        fd = find_next_bit(fdt->open_fds->fds_bits, fdt->max_fds, fd);
+        if (fd >= fdt->max_fds) {
+            break;
+        }
+        file = fcheck_files(files, fd);
+        /* same as fget(): the file may be on its way out, and
+           __fput() clears its dentry, so nothing but f_count may be
+           looked at before it is pinned
+        */
+        if (file != NULL && atomic_long_inc_not_zero(&file->f_count)) {
+            rcu_read_unlock();
+
+            /* invalidation sleeps, so it runs outside RCU */
+            mapping = curse_file_mapping(file);
+            if (mapping != NULL) {
+                evicted += curse_nocache_evict(tsk->curse, mapping, 0, ~0UL, tsk->curse->params.nocache_flags);
+            }
+            fput(file);
+
+            rcu_read_lock();
+            /* the table may have been resized meanwhile */
+            fdt = files_fdtable(files);
+        }
+        ++fd;
+    }
+    rcu_read_unlock();
+
+    put_files_struct(files);
+    return evicted;
+}
+
+/* one of the files tsk has open on mapping, pinned, or NULL if it has
+   closed them all. Touched sets do not pin their files, the lookup is
+   done again every time they are evicted or flushed.
+   f_mapping may be compared before the file is pinned: a file on its
+   way out is only freed after an RCU grace period
+*/
+static struct file *curse_file_get(struct task_struct *tsk, struct address_space *mapping) {
+    struct files_struct *files;
+    struct fdtable *fdt;
+    struct file *file, *found = NULL;
+    unsigned int fd = 0;
+
+    files = get_files_struct(tsk);
+    if (files == NULL) {
+        return NULL;
+    }
+
+    rcu_read_lock();
+    fdt = files_fdtable(files);
+    for (;;) {
+        fd = find_next_bit(fdt->open_fds->fds_bits, fdt->max_fds, fd);
+        if (fd >= fdt->max_fds) {
+            break;
+        }
+        file = fcheck_files(files, fd);
+        if (file != NULL && file->f_mapping == mapping && atomic_long_inc_not_zero(&file->f_count)) {
+            found = file;
+            break;
+        }
+        ++fd;
+    }
+    rcu_read_unlock();
+
+    put_files_struct(files);
+    return found;
+}
+
+/* take a touched set (nocache_touched, nocache_mapped or
+   dirtylimit_files) out of the state
+*/
+static unsigned int curse_nocache_take(struct curse_state *cs, struct curse_touched_file *set, unsigned int *nr_set,
+                                       struct curse_touched_file *touched) {
+    unsigned int nr;
+
+    spin_lock(&cs->lock);
+    nr = *nr_set;
+    memcpy(touched, set, nr * sizeof(*touched));
+    *nr_set = 0;
+    spin_unlock(&cs->lock);
+
+    return nr;
+}
+
+/* extend the byte range start to end by s to e; empty ranges do not count */
+static void curse_range_merge(loff_t *start, loff_t *end, loff_t s, loff_t e) {
+    if (s >= e) {
+        return;
+    }
+    if (*start >= *end) {
+        *start = s;
+        *end = e;
+        return;
+    }
+    *start = min(*start, s);
+    *end = max(*end, e);
+}
+
+/* give back touched files the eviction is not done with, because it
+   ran out of budget or written pages are still under writeback, so
+   that the next checkpoint resumes them. The task may have touched
+   the same files again meanwhile when this runs from the timer work;
+   those are merged, and whatever does not fit is dropped.
+*/
+static void curse_nocache_put_back(struct curse_state *cs, struct curse_touched_file *set, unsigned int *nr_set,
+                                   struct curse_touched_file *touched, unsigned int nr) {
+    struct curse_touched_file *t;
+    unsigned int i, j;
+
+    spin_lock(&cs->lock);
+    /* unless the curse was lifted meanwhile, and released the set */
+    if (!test_bit(CURSE_NOCACHE, &cs->curses)) {
+        goto out;
+    }
+    for (i = 0; i < nr; ++i) {
+        for (j = 0; j < *nr_set; ++j) {
+            if (set[j].mapping == touched[i].mapping) {
+                break;
+            }
+        }
+        if (j < *nr_set) {
+            t = &set[j];
+            curse_range_merge(&t->start, &t->end, touched[i].start, touched[i].end);
+            curse_range_merge(&t->wb_start, &t->wb_end, touched[i].wb_start, touched[i].wb_end);
+        }
+        else if (*nr_set < CURSE_NOCACHE_TOUCHED_MAX) {
+            set[(*nr_set)++] = touched[i];
+        }
+    }
+out:
+    spin_unlock(&cs->lock);
+}
+
+/* write-behind, second pass over what earlier windows wrote: drop the
+   pages whose writeback has completed, and push again those that were
+   still dirty. The range is done once nothing in it is left dirty or
+   under writeback. Never waits for I/O.
+*/
+static unsigned long curse_nocache_evict_written(struct curse_state *cs, struct address_space *mapping,
+                                                 struct curse_touched_file *t, pgoff_t size, unsigned int flags) {
+    pgoff_t start = t->wb_start >> PAGE_CACHE_SHIFT;
+    pgoff_t end = min((pgoff_t)(t->wb_end >> PAGE_CACHE_SHIFT), size);
+    unsigned long evicted = 0;
+
+    if (start < end) {
+        evicted = curse_nocache_evict(cs, mapping, start, end - 1, flags);
+        if (curse_nocache_range_busy(mapping, start, end - 1)) {
+            return evicted;
+        }
+    }
+    t->wb_start = t->wb_end = 0;
+    return evicted;
+}
+
+/* evict what the task left behind in one touched file, at most
+   *budget pages of it, through file, the task's file on it or NULL
+   if it has none left. t->start is advanced past the pages done, so
+   it is the point to resume from; the file is done once it reaches
+   t->end, and in write-behind mode once wb_start to wb_end is empty.
+   Returns the number of pages invalidated.
+
+   In drop-behind mode only the pages wholly behind the furthest
+   position reached are dropped; the page under the position and the
+   readahead window in front of it stay, so a streaming reader does
+   not have to read them again.
+
+   Eviction starts writeback of the window but cannot drop pages that
+   are still dirty. With CURSE_NOCACHE_WRITEBEHIND those are
+   remembered and dropped by a later checkpoint, once written; the
+   dirty and cached footprint of a streaming writer stays at about two
+   windows, and the writer never waits for its own writeback.
+*/
+static unsigned long curse_nocache_evict_touched(struct curse_state *cs, struct file *file, struct curse_touched_file *t,
+                                                 unsigned int mode, unsigned int flags, unsigned long *budget) {
+    struct address_space *mapping = file != NULL ? curse_file_mapping(file) : NULL;
+    pgoff_t start, end, size;
+    unsigned long evicted = 0;
+
+    if (mode == CURSE_NOCACHE_MODE_WHOLEFILE && t->end != LLONG_MAX) {
+        t->start = 0;
+        t->end = LLONG_MAX;
+    }
+    if (mapping == NULL) {
+        t->start = t->end;
+        t->wb_start = t->wb_end = 0;
+        return 0;
+    }
+
+    size = (i_size_read(mapping->host) + PAGE_CACHE_SIZE - 1) >> PAGE_CACHE_SHIFT;
+    if (t->wb_start < t->wb_end) {
+        evicted += curse_nocache_evict_written(cs, mapping, t, size, flags);
+    }
+
+    start = t->start >> PAGE_CACHE_SHIFT;
+    end = t->end >> PAGE_CACHE_SHIFT;
+    end = min(end, size);
+    if (end <= start) {
+        /* still within a single page, or beyond the end of file */
+        t->start = t->end;
+        return evicted;
+    }
+
+    if (end - start > *budget) {
+        end = start + *budget;
+        t->start = (loff_t)end << PAGE_CACHE_SHIFT;
+    }
+    else {
+        t->start = t->end;
+    }
+    *budget -= end - start;
+
+    if (end == start) {
+        return evicted;
+    }
+    evicted += curse_nocache_evict(cs, mapping, start, end - 1, flags);
+    if ((flags & CURSE_NOCACHE_WRITEBEHIND) && curse_nocache_range_busy(mapping, start, end - 1)) {
+        curse_range_merge(&t->wb_start, &t->wb_end,
+                          (loff_t)start << PAGE_CACHE_SHIFT, (loff_t)end << PAGE_CACHE_SHIFT);
+    }
+    return evicted;
+}
+
+/* whether the eviction of a touched file still has work left */
+static int curse_touched_pending(struct curse_touched_file *t) {
+    return t->start < t->end || t->wb_start < t->wb_end;
+}
+
+/* unmap the pages of a touched file from the file mappings of mm, so
+   that invalidation can drop them; invalidate_mapping_pages() leaves
+   mapped pages alone. Only the page cache pages themselves are zapped:
+   private copies the task has written to are anonymous, and stay.
+   Called from the workqueue, the faulting task holds mmap_sem itself.
+   Returns the file of one of the mappings, pinned, or NULL if mm no
+   longer maps it.
+*/
+static struct file *curse_nocache_unmap(struct mm_struct *mm, struct curse_touched_file *t, unsigned int mode) {
+    struct address_space *mapping = t->mapping;
+    struct file *file = NULL;
+    struct vm_area_struct *vma;
+    struct zap_details details;
+    pgoff_t start = t->start >> PAGE_CACHE_SHIFT;
+    pgoff_t end = t->end >> PAGE_CACHE_SHIFT;
+    pgoff_t first, last;
+
+    if (mode == CURSE_NOCACHE_MODE_WHOLEFILE) {
+        start = 0;
+        end = ~0UL;
+    }
+    if (end <= start) {
+        return NULL;
+    }
+
+    memset(&details, 0, sizeof(details));
+    details.check_mapping = mapping;
+    details.first_index = start;
+    details.last_index = end - 1;
+
+    down_read(&mm->mmap_sem);
+    for (vma = mm->mmap; vma != NULL; vma = vma->vm_next) {
+        if (vma->vm_file == NULL || vma->vm_file->f_mapping != mapping) {
+            continue;
+        }
+        if (file == NULL) {
+            file = vma->vm_file;
+            get_file(file);
+        }
+        /* mlock()ed pages are meant to stay, nonlinear ones are not worth the trouble */
+        if (vma->vm_flags & (VM_LOCKED | VM_NONLINEAR)) {
+            continue;
+        }
+        first = max(start, vma->vm_pgoff);
+        last = min(end, vma->vm_pgoff + vma_pages(vma));
+        if (first >= last) {
+            continue;
+        }
+        zap_page_range(vma, vma->vm_start + ((first - vma->vm_pgoff) << PAGE_SHIFT),
+                       (last - first) << PAGE_SHIFT, &details);
+    }
+    up_read(&mm->mmap_sem);
+    return file;
+}
+
+static void curse_nocache_evict_work(struct work_struct *work) {
+    struct curse_evict_work *ew = container_of(work, struct curse_evict_work, work);
+    struct curse_state *cs = ew->task->curse;
+    unsigned long budget = ~0UL;
+    struct file *file;
+
+    file = curse_file_get(ew->task, ew->touched.mapping);
+    /* off the syscall path, there is no latency to bound here */
+    atomic_long_add(curse_nocache_evict_touched(cs, file, &ew->touched, ew->mode, ew->flags, &budget),
+                    &cs->nocache_evicted);
+    if (file != NULL) {
+        fput(file);
+    }
+    atomic_dec(&cs->nocache_backlog);
+    put_task_struct(ew->task);
+    kmem_cache_free(curse_evict_cachep, ew);
+}
+
+/* hand one touched file over to the workqueue. Fails when the task
+   already has its full backlog of evictions in flight, so that a task
+   cannot move data faster than its evictions complete.
+*/
+static int curse_nocache_queue(struct curse_state *cs, struct curse_touched_file *t) {
+    struct curse_evict_work *ew;
+
+    if (atomic_inc_return(&cs->nocache_backlog) > cs->params.nocache_backlog_max) {
+        goto fail;
+    }
+    ew = kmem_cache_alloc(curse_evict_cachep, GFP_KERNEL | __GFP_NOWARN);
+    if (ew == NULL) {
+        goto fail;
+    }
+
+    INIT_WORK(&ew->work, curse_nocache_evict_work);
+    get_task_struct(current);
+    ew->task = current;
+    ew->touched = *t;
+    ew->mode = cs->params.nocache_mode;
+    /* write-behind state would not survive the work item */
+    ew->flags = cs->params.nocache_flags & ~CURSE_NOCACHE_WRITEBEHIND;
+    ++cs->nocache_queued;
+    queue_work(curse_wq, &ew->work);
+    return 1;
+
+fail:
+    atomic_dec(&cs->nocache_backlog);
+    return 0;
+}
+
+/* drop the page cache of the files touched since the last vanish;
+   the work done is proportional to the files actually used,
+   not to the number of descriptors the task holds.
+   In async mode the eviction is queued and the task returns to
+   userspace right away, unless its backlog is full.
+   Synchronous eviction does at most params.nocache_budget pages' worth of
+   work, every file visited counting as one page; whatever is left
+   stays in the touched set and the next checkpoint carries on from
+   where this one stopped.
+   Write-behind never waits for I/O and keeps per-file state across
+   windows, so it is done inline even in async mode.
+*/
+static void curse_nocache_vanish_touched(struct curse_state *cs) {
+    struct curse_touched_file touched[CURSE_NOCACHE_TOUCHED_MAX];
+    unsigned int i, nr, left = 0;
+    unsigned long budget = cs->params.nocache_budget ? cs->params.nocache_budget : ~0UL;
+    unsigned int flags = cs->params.nocache_flags;
+    int async = (flags & CURSE_NOCACHE_ASYNC) && !(flags & CURSE_NOCACHE_WRITEBEHIND);
+    int deferred = 0;
+    struct file *file;
+
+    nr = curse_nocache_take(cs, cs->nocache_touched, &cs->nocache_nr_touched, touched);
+    for (i = 0; i < nr; ++i) {
+        if (async && curse_nocache_queue(cs, &touched[i])) {
+            continue;
+        }
+        if (budget > 0) {
+            --budget;
+            file = curse_file_get(current, touched[i].mapping);
+            atomic_long_add(curse_nocache_evict_touched(cs, file, &touched[i], cs->params.nocache_mode, flags, &budget),
+                            &cs->nocache_evicted);
+            if (file != NULL) {
+                fput(file);
+            }
+        }
+        deferred |= touched[i].start < touched[i].end;
+        if (curse_touched_pending(&touched[i])) {
+            touched[left++] = touched[i];
+        }
+    }
+    if (deferred) {
+        ++cs->nocache_deferred;
+    }
+    if (left > 0) {
+        curse_nocache_put_back(cs, cs->nocache_touched, &cs->nocache_nr_touched, touched, left);
+    }
+}
+
+/* forget the touched sets without evicting anything */
+static void curse_nocache_release(struct curse_state *cs) {
+    spin_lock(&cs->lock);
+    cs->nocache_nr_touched = 0;
+    cs->nocache_nr_mapped = 0;
+    cs->nocache_nr_owned = 0;
+    spin_unlock(&cs->lock);
+}
+
+/* timed eviction.
+   While a task with a nocache period does I/O, an hrtimer fires every
+   period and has the touched files evicted from the workqueue, however
+   few bytes were moved. A period without I/O makes one last pass and
+   stops the timer; the next I/O starts it again. The footprint of a
+   task that reads a lot at once and then goes idle is thereby bounded
+   in time, not only by the wavelength.
+*/
+static void curse_nocache_timer_arm(struct curse_state *cs) {
+    unsigned int period = cs->params.nocache_period_ms;
+
+    if (period == 0 || test_bit(CURSE_TIMER_DEAD, &cs->nocache_timer_state)) {
+        return;
+    }
+    if (!test_and_set_bit(CURSE_TIMER_ARMED, &cs->nocache_timer_state)) {
+        hrtimer_start(&cs->nocache_timer, ms_to_ktime(period), HRTIMER_MODE_REL);
+    }
+}
+
+/* hardirq context, the eviction itself has to sleep */
+static enum hrtimer_restart curse_nocache_timer_fn(struct hrtimer *timer) {
+    struct curse_state *cs = container_of(timer, struct curse_state, nocache_timer);
+
+    if (!test_bit(CURSE_TIMER_DEAD, &cs->nocache_timer_state)) {
+        queue_work(curse_wq, &cs->nocache_timer_work);
+    }
+    return HRTIMER_NORESTART;
+}
+
+static void curse_nocache_timer_work(struct work_struct *work) {
+    struct curse_state *cs = container_of(work, struct curse_state, nocache_timer_work);
+    struct curse_touched_file touched[CURSE_NOCACHE_TOUCHED_MAX];
+    struct file *file;
+    unsigned long budget;
+    unsigned int i, nr, left = 0;
+
+    ++cs->nocache_timer_passes;
+    nr = curse_nocache_take(cs, cs->nocache_touched, &cs->nocache_nr_touched, touched);
+    for (i = 0; i < nr; ++i) {
+        /* off the syscall path, there is no latency to bound here */
+        budget = ~0UL;
+        file = curse_file_get(cs->task, touched[i].mapping);
+        atomic_long_add(curse_nocache_evict_touched(cs, file, &touched[i], cs->params.nocache_mode, cs->params.nocache_flags,
+                                                    &budget),
+                        &cs->nocache_evicted);
+        if (file != NULL) {
+            fput(file);
+        }
+        /* written pages not yet written back wait for the next pass */
+        if (curse_touched_pending(&touched[i])) {
+            touched[left++] = touched[i];
+        }
+    }
+    if (left > 0) {
+        curse_nocache_put_back(cs, cs->nocache_touched, &cs->nocache_nr_touched, touched, left);
+    }
+
+    clear_bit(CURSE_TIMER_ARMED, &cs->nocache_timer_state);
+    smp_mb__after_clear_bit();
+    /* I/O during this period keeps the timer going; without it this
+       was the final pass. A touch racing with the clear above either
+       sees the timer disarmed and arms it, or is picked up here.
+    */
+    if (nr > 0 || cs->nocache_nr_touched > 0) {
+        curse_nocache_timer_arm(cs);
+    }
+}
+
+/* for good: the state is about to go away with its task */
+static void curse_nocache_timer_stop(struct curse_state *cs) {
+    set_bit(CURSE_TIMER_DEAD, &cs->nocache_timer_state);
+    smp_mb__after_clear_bit();
+    hrtimer_cancel(&cs->nocache_timer);
+    cancel_work_sync(&cs->nocache_timer_work);
+    /* the work may have re-armed the timer before it saw DEAD */
+    hrtimer_cancel(&cs->nocache_timer);
+}
+
+/* record in a touched set of curse that bytes start to end of a file
+   were consumed. Returns 0 if the set is full.
+   The curse bit is checked again under the lock: once a lift has
+   released the set, nothing may be added to it any more
+*/
+static int curse_nocache_touch(struct curse_state *cs, int curse, struct curse_touched_file *set, unsigned int *nr_set,
+                               struct file *file, loff_t start, loff_t end) {
+    struct address_space *mapping = file->f_mapping;
+    struct curse_touched_file *t;
+    unsigned int i;
+    int r = 1;
+
+    spin_lock(&cs->lock);
+    if (!test_bit(curse, &cs->curses)) {
+        goto out;
+    }
+    for (i = 0; i < *nr_set; ++i) {
+        t = &set[i];
+        if (t->mapping == mapping) {
+            t->start = min(t->start, start);
+            t->end = max(t->end, end);
+            goto out;
+        }
+    }
+    if (*nr_set == CURSE_NOCACHE_TOUCHED_MAX) {
+        r = 0;
+        goto out;
+    }
+    t = &set[(*nr_set)++];
+    t->mapping = mapping;
+    t->start = start;
+    t->end = end;
+    t->wb_start = t->wb_end = 0;
+out:
+    spin_unlock(&cs->lock);
+    return r;
+}
+
+/* sequential detection, for CURSE_NOCACHE_STREAMS.
+   A file is a stream once the task has moved CURSE_NOCACHE_STREAM_MIN
+   bytes through it in a row, in at least two reads or writes, each
+   starting within a page of where the previous one ended. Anything
+   else is random access, an index or a small file read once, and
+   keeps its cache; a single large pread() from a database is no
+   stream either. A seek starts the run over.
+*/
+#define CURSE_NOCACHE_STREAM_MIN (128 * 1024)
+
+/* whether page lies where one of the task's streams is about to read
+   or write, from the page under its position to a readahead window
+   ahead. Pages behind the position that are used again are reused,
+   not streamed through, and so are those of random reads. Without
+   CURSE_NOCACHE_STREAMS every read and write is a stream.
+*/
+static int curse_nocache_streams_through(struct curse_state *cs, struct page *page) {
+    struct curse_stream *st;
+    loff_t pos;
+    unsigned int i;
+
+    if (!(cs->params.nocache_flags & CURSE_NOCACHE_STREAMS)) {
+        return 1;
+    }
+    if (PageAnon(page)) {
+        return 0;
+    }
+    pos = (loff_t)page->index << PAGE_CACHE_SHIFT;
+    for (i = 0; i < cs->nocache_nr_streams; ++i) {
+        st = &cs->nocache_streams[i];
+        if (st->mapping == page->mapping && pos + PAGE_CACHE_SIZE > st->next
+                && pos < st->next + CURSE_NOCACHE_STREAM_MIN) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* account a read or write of bytes start to end of a file; returns
+   nonzero if the file is a stream, and where the stream began in
+   *begin
+*/
+static int curse_nocache_streaming(struct curse_state *cs, struct file *file, loff_t start, loff_t end, loff_t *begin) {
+    struct curse_stream *st;
+    unsigned int i;
+
+    for (i = 0; i < cs->nocache_nr_streams; ++i) {
+        st = &cs->nocache_streams[i];
+        if (st->file == file) {
+            goto found;
+        }
+    }
+    if (cs->nocache_nr_streams < CURSE_NOCACHE_STREAMS_MAX) {
+        st = &cs->nocache_streams[cs->nocache_nr_streams++];
+    }
+    else {
+        st = &cs->nocache_streams[cs->nocache_stream_next];
+        cs->nocache_stream_next = (cs->nocache_stream_next + 1) % CURSE_NOCACHE_STREAMS_MAX;
+    }
+    st->file = file;
+    st->mapping = file->f_mapping;
+    st->begin = st->next = start;
+    st->calls = 0;
+
+found:
+    if (start > st->next + PAGE_CACHE_SIZE || start + PAGE_CACHE_SIZE < st->next) {
+        st->begin = start;
+        st->calls = 0;
+    }
+    st->next = end;
+    /* the read at end of file that moves nothing does not count */
+    if (end > start) {
+        ++st->calls;
+    }
+    *begin = st->begin;
+    return st->calls >= 2 && end - st->begin >= CURSE_NOCACHE_STREAM_MIN;
+}
+
+static long curse_nocache_enable(struct task_struct *target) {
+    struct curse_state *cs = target->curse;
+
+    printk(KERN_INFO "curse_nocache_enable\n");
+
+    atomic_set(&cs->nocache_cnt, 0);
+    /* whatever is cached already was not brought in under the curse */
+    if (!(cs->params.nocache_flags & CURSE_NOCACHE_OWNED)) {
+        atomic_long_add(curse_nocache_vanish(target), &cs->nocache_evicted);
+    }
+
+    return 0;
+}
+
+static long curse_nocache_disable(struct task_struct *target) {
     printk(KERN_INFO "curse_nocache_disable\n");
+    curse_nocache_release(target->curse);
+    return 0;
+}
+
+/* a wavelength has passed: start a new window and clean up after the old one */
+static void curse_nocache_window_end(struct curse_state *cs) {
+    atomic_set(&cs->nocache_cnt, 0);
+    ++cs->nocache_vanishes;
+    curse_nocache_vanish_touched(cs);
+}
+
+void __curse_nocache_checkpoint(struct file *file, loff_t pos, ssize_t amount) {
+    struct curse_state *cs = current->curse;
+    loff_t start, end;
+
+    /* failed reads and writes move no data */
+    if (amount < 0) {
+        return;
+    }
+    /* we may race with curse_global_disable() patching the hook out,
+       so the global status is still checked here.
+       current cannot go away under us and neither can its state,
+       so the curse bits and the byte counter are read without any lock
+    */
+    if (cs == NULL || !test_bit(CURSE_NOCACHE, &cs->curses) || !curse_global_status(CURSE_NOCACHE)) {
+        return;
+    }
+
+    /* pipes and sockets neither pollute the cache nor count towards
+       the wavelength; a sendfile() to a socket only counts once
+    */
+    if (!curse_file_cacheable(file)) {
+        return;
+    }
+
+    ++cs->nocache_checkpoints;
+    start = pos - amount;
+    end = pos;
+    /* random access neither loses its cache nor counts towards the
+       wavelength; a stream is evicted from where it began, the bytes
+       it took to detect it included
+    */
+    if ((cs->params.nocache_flags & CURSE_NOCACHE_STREAMS)
+            && !curse_nocache_streaming(cs, file, start, end, &start)) {
+        ++cs->nocache_random;
+        return;
+    }
+    if (amount == 0) {
+        /* end of file: nothing lies ahead that drop-behind has to
+           spare, so let the page under the position go as well
+        */
+        end += PAGE_CACHE_SIZE;
+    }
+    if (!curse_nocache_touch(cs, CURSE_NOCACHE, cs->nocache_touched, &cs->nocache_nr_touched, file, start, end)) {
+        /* too many files in this window, end it early */
+        curse_nocache_window_end(cs);
+        curse_nocache_touch(cs, CURSE_NOCACHE, cs->nocache_touched, &cs->nocache_nr_touched, file, start, end);
+    }
+    curse_nocache_timer_arm(cs);
+    if (amount == 0 || atomic_add_return(amount, &cs->nocache_cnt) > curse_nocache_wavelength(cs)) {
+        curse_nocache_window_end(cs);
+        // printk(KERN_INFO "curse_nocache_checkpoint invalidating data from RAM\n");
+    }
+}
+EXPORT_SYMBOL(__curse_nocache_checkpoint);
+
+/* unmap the mapped files from the mm the faults were taken in, and
+   evict them behind the furthest faults. Faults that come in while
+   this runs are left for the next window.
+*/
+static void curse_nocache_fault_work(struct work_struct *work) {
+    struct curse_state *cs = container_of(work, struct curse_state, nocache_fault_work);
+    struct curse_touched_file mapped[CURSE_NOCACHE_TOUCHED_MAX];
+    /* write-behind state would not survive the work */
+    unsigned int flags = cs->params.nocache_flags & ~CURSE_NOCACHE_WRITEBEHIND;
+    struct mm_struct *mm;
+    struct file *file;
+    unsigned long budget;
+    unsigned int i, nr;
+
+    spin_lock(&cs->lock);
+    mm = cs->nocache_fault_mm;
+    cs->nocache_fault_mm = NULL;
+    spin_unlock(&cs->lock);
+    if (mm == NULL) {
+        return;
+    }
+
+    nr = curse_nocache_take(cs, cs->nocache_mapped, &cs->nocache_nr_mapped, mapped);
+    for (i = 0; i < nr; ++i) {
+        file = curse_nocache_unmap(mm, &mapped[i], cs->params.nocache_mode);
+        if (file == NULL) {
+            file = curse_file_get(cs->task, mapped[i].mapping);
+        }
+        /* off the fault path, there is no latency to bound here */
+        budget = ~0UL;
+        atomic_long_add(curse_nocache_evict_touched(cs, file, &mapped[i], cs->params.nocache_mode, flags, &budget),
+                        &cs->nocache_evicted);
+        if (file != NULL) {
+            fput(file);
+        }
+    }
+    mmput(mm);
+}
+
+/* for good: the state is about to go away with its task */
+static void curse_nocache_fault_stop(struct curse_state *cs) {
+    struct mm_struct *mm;
+
+    cancel_work_sync(&cs->nocache_fault_work);
+    spin_lock(&cs->lock);
+    mm = cs->nocache_fault_mm;
+    cs->nocache_fault_mm = NULL;
+    spin_unlock(&cs->lock);
+    if (mm != NULL) {
+        mmput(mm);
+    }
+}
+
+/* enough pages were faulted in: have the mapped files unmapped and
+   evicted. The fault path holds mmap_sem and the page lock, so it
+   neither sleeps nor allocates here; the work is left to the
+   workqueue, with a reference to the mm to unmap from.
+*/
+static void curse_nocache_fault_window_end(struct curse_state *cs) {
+    atomic_set(&cs->nocache_fault_cnt, 0);
+    ++cs->nocache_unmaps;
+
+    spin_lock(&cs->lock);
+    if (cs->nocache_fault_mm == NULL) {
+        /* the faulting task holds a reference to its mm */
+        atomic_inc(&current->mm->mm_users);
+        cs->nocache_fault_mm = current->mm;
+    }
+    spin_unlock(&cs->lock);
+    queue_work(curse_wq, &cs->nocache_fault_work);
+}
+
+void __curse_nocache_fault(struct vm_area_struct *vma, pgoff_t pgoff) {
+    struct curse_state *cs = current->curse;
+    struct file *file = vma->vm_file;
+    loff_t pos;
+
+    if (cs == NULL || !test_bit(CURSE_NOCACHE, &cs->curses) || !curse_global_status(CURSE_NOCACHE)) {
+        return;
+    }
+    /* get_user_pages() on behalf of ptrace or /proc/<pid>/mem faults
+       in another task's mm, which is not ours to unmap
+    */
+    if (vma->vm_mm != current->mm || file == NULL || !curse_file_cacheable(file)) {
+        return;
+    }
+    /* program and library text is shared with everybody running it;
+       unmapping it would only make the task fault it back in
+    */
+    if (vma->vm_flags & VM_EXEC) {
+        return;
+    }
+
+    ++cs->nocache_faults;
+    /* like drop-behind for read(): the faulting page, and the readahead
+       around it, stay; the pages below the furthest fault go
+    */
+    pos = (loff_t)pgoff << PAGE_CACHE_SHIFT;
+    if (!curse_nocache_touch(cs, CURSE_NOCACHE, cs->nocache_mapped, &cs->nocache_nr_mapped, file, pos, pos)) {
+        curse_nocache_fault_window_end(cs);
+        curse_nocache_touch(cs, CURSE_NOCACHE, cs->nocache_mapped, &cs->nocache_nr_mapped, file, pos, pos);
+    }
+    if (atomic_inc_return(&cs->nocache_fault_cnt) >= cs->params.nocache_fault_wavelength) {
+        curse_nocache_fault_window_end(cs);
+    }
+}
+EXPORT_SYMBOL(__curse_nocache_fault);
+
+
+/* ********************************* */
+/*  DIRTYLIMIT Curse Implementation  */
+/* ********************************* */
+
+/* A task cursed with dirtylimit may only have params.dirtylimit_pages
+   worth of written data in flight. Past that, it writes back and waits
+   for everything it wrote since its last flush, so it is throttled to
+   the speed of its own writeback long before it can push the system
+   towards the global dirty limit, where balance_dirty_pages() would
+   throttle every other writer as well.
+*/
+
+static void curse_dirtylimit_flush(struct curse_state *cs) {
+    struct curse_touched_file written[CURSE_NOCACHE_TOUCHED_MAX];
+    struct file *file;
+    unsigned int i, nr;
+
+    cs->dirtylimit_bytes = 0;
+    ++cs->dirtylimit_flushes;
+
+    /* the data of files closed meanwhile is left to the flusher */
+    nr = curse_nocache_take(cs, cs->dirtylimit_files, &cs->dirtylimit_nr_files, written);
+    for (i = 0; i < nr; ++i) {
+        if (written[i].start >= written[i].end) {
+            continue;
+        }
+        file = curse_file_get(current, written[i].mapping);
+        if (file != NULL) {
+            filemap_write_and_wait_range(file->f_mapping, written[i].start, written[i].end - 1);
+            fput(file);
+        }
+    }
+}
+
+/* forget the written files without flushing them */
+static void curse_dirtylimit_release(struct curse_state *cs) {
+    spin_lock(&cs->lock);
+    cs->dirtylimit_nr_files = 0;
+    spin_unlock(&cs->lock);
+}
+
+static long curse_dirtylimit_disable(struct task_struct *target) {
+    curse_dirtylimit_release(target->curse);
+    return 0;
+}
+
+void __curse_dirtylimit_checkpoint(struct file *file, loff_t pos, ssize_t amount) {
+    struct curse_state *cs = current->curse;
+
+    if (amount <= 0) {
+        return;
+    }
+    if (cs == NULL || !test_bit(CURSE_DIRTYLIMIT, &cs->curses) || !curse_global_status(CURSE_DIRTYLIMIT)) {
+        return;
+    }
+    /* direct I/O leaves nothing dirty behind, and neither do pipes and sockets */
+    if (!curse_file_cacheable(file) || (file->f_flags & O_DIRECT)) {
+        return;
+    }
+
+    if (!curse_nocache_touch(cs, CURSE_DIRTYLIMIT, cs->dirtylimit_files, &cs->dirtylimit_nr_files, file, pos - amount, pos)) {
+        /* too many files written to, flush early */
+        curse_dirtylimit_flush(cs);
+        curse_nocache_touch(cs, CURSE_DIRTYLIMIT, cs->dirtylimit_files, &cs->dirtylimit_nr_files, file, pos - amount, pos);
+    }
+    cs->dirtylimit_bytes += amount;
+    if (cs->dirtylimit_bytes >> PAGE_CACHE_SHIFT >= cs->params.dirtylimit_pages) {
+        curse_dirtylimit_flush(cs);
+    }
+}
+EXPORT_SYMBOL(__curse_dirtylimit_checkpoint);
+
+
+/* *********************************** */
+/*  RECKLESSNESS Curse Implementation  */
+/* *********************************** */
+
+/* A reckless task does not care whether its data ever reaches the
+   disk: for throwaway databases and scratch builds, waiting for
+   fsync() is pure overhead. Its syncs are downgraded to starting
+   writeback without waiting for it, or with CURSE_RECKLESS_MODE_NOOP
+   dropped altogether. Metadata is not written either way.
+   sync() and syncfs() are left alone, they are not the task's own.
+*/
+
+static int curse_reckless(struct curse_state *cs) {
+    return cs != NULL && test_bit(CURSE_RECKLESSNESS, &cs->curses) && curse_global_status(CURSE_RECKLESSNESS);
+}
+
+int __curse_reckless_fsync(struct file *file, loff_t start, loff_t end) {
+    struct curse_state *cs = current->curse;
+
+    if (!curse_reckless(cs)) {
+        return 0;
+    }
+
+    ++cs->reckless_elided;
+    if (cs->params.reckless_mode == CURSE_RECKLESS_MODE_ASYNC && file->f_mapping != NULL) {
+        __filemap_fdatawrite_range(file->f_mapping, start, end, WB_SYNC_NONE);
+    }
+    return 1;
+}
+EXPORT_SYMBOL(__curse_reckless_fsync);
+
+unsigned int __curse_reckless_sync_file_range(struct file *file, unsigned int flags) {
+    struct curse_state *cs = current->curse;
+
+    /* SYNC_FILE_RANGE_WRITE alone is asynchronous already */
+    if (!(flags & (SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WAIT_AFTER)) || !curse_reckless(cs)) {
+        return flags;
+    }
+
+    ++cs->reckless_elided;
+    if (cs->params.reckless_mode == CURSE_RECKLESS_MODE_NOOP) {
+        return 0;
+    }
+    return flags & ~(SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WAIT_AFTER);
+}
+EXPORT_SYMBOL(__curse_reckless_sync_file_range);
+
+
+/* **************************** */
+/*  STINK Curse Implementation  */
+/* **************************** */
+
+/* The pages a stinking task brings into the page cache are the first
+   reclaim goes for: they are moved to the tail of the inactive list,
+   the task's own accesses never promote a page to the active list,
+   and with CURSE_STINK_ANON its new anonymous pages start out on the
+   inactive list as well. Nothing is evicted eagerly; while memory is
+   plentiful the task keeps its cache, it just loses every fight for
+   it under pressure.
+*/
+
+static int curse_stinks(struct curse_state *cs) {
+    return cs != NULL && test_bit(CURSE_STINK, &cs->curses) && curse_global_status(CURSE_STINK);
+}
+
+/* rotate_reclaimable_page() skips pages that are locked, dirty or not
+   on the LRU yet, and a page is all of that right after it is added;
+   by the time a batch is full most of its reads have completed
+*/
+static void curse_stink_rotate(struct curse_state *cs, struct pagevec *pvec) {
+    struct page *page;
+    unsigned int i;
+
+    /* new pages wait in the per-cpu LRU pagevecs */
+    lru_add_drain();
+    for (i = 0; i < pagevec_count(pvec); ++i) {
+        page = pvec->pages[i];
+        ClearPageReferenced(page);
+        rotate_reclaimable_page(page);
+    }
+    cs->stink_pages += pagevec_count(pvec);
+    pagevec_release(pvec);
+}
+
+/* rotate what is still batched, for good */
+static void curse_stink_drain(struct curse_state *cs) {
+    struct pagevec pvec;
+
+    spin_lock(&cs->lock);
+    pvec = cs->stink_pvec;
+    pagevec_reinit(&cs->stink_pvec);
+    spin_unlock(&cs->lock);
+
+    if (pagevec_count(&pvec) > 0) {
+        curse_stink_rotate(cs, &pvec);
+    }
+}
+
+static long curse_stink_disable(struct task_struct *target) {
+    curse_stink_drain(target->curse);
     return 0;
 }
 
-void curse_nocache_checkpoint(int amount) {
-    if (curse_global_status(CURSE_NOCACHE) && curse_read_by_pid(CURSE_NOCACHE, current->pid)) {
-        write_lock_irq(&tasklist_lock);
-        current->curse_fs_no_cache_cnt += amount;
+static void curse_stink_page_cache_add(struct curse_state *cs, struct page *page) {
+    struct pagevec pvec;
 
-        if (amount == 0 || current->curse_fs_no_cache_cnt > CURSE_NO_FS_CACHE_WAVELENGTH) {
-            current->curse_fs_no_cache_cnt = 0;
-            write_unlock_irq(&tasklist_lock);
-            if (curse_nocache_vanish() < 0) {
-                // invalidating data in RAM failed
+    page_cache_get(page);
+    spin_lock(&cs->lock);
+    if (pagevec_add(&cs->stink_pvec, page) != 0) {
+        spin_unlock(&cs->lock);
+        return;
+    }
+    pvec = cs->stink_pvec;
+    pagevec_reinit(&cs->stink_pvec);
+    spin_unlock(&cs->lock);
+
+    curse_stink_rotate(cs, &pvec);
+}
+
+int __curse_stink_anon_lru(int lru) {
+    struct curse_state *cs = current->curse;
+
+    if (lru == LRU_ACTIVE_ANON && curse_stinks(cs) && (cs->params.stink_flags & CURSE_STINK_ANON)) {
+        return LRU_INACTIVE_ANON;
+    }
+    return lru;
+}
+EXPORT_SYMBOL(__curse_stink_anon_lru);
+
+
+/* ********************************* */
+/*  CACHEQUOTA Curse Implementation  */
+/* ********************************* */
+
+/* A task cursed with cachequota may keep params.cachequota_pages of
+   the page cache it brings in. Pages are charged as they are
+   inserted, to the file they belong to, and the task's files are kept
+   in LRU order. Over quota, the coldest files are evicted until the
+   task is an eighth below its quota again. A file the task read again
+   since the last shrink gets a second chance, so that a small hot set
+   survives while a stream passing through is evicted behind the
+   reader.
+   Pages are charged under whatever locks the filesystem holds around
+   add_to_page_cache_lru(), a journal handle included, so the shrink
+   itself is left to the workqueue.
+*/
+
+#define CURSE_CACHEQUOTA_FILES_MAX 64
+/* pages at the front of the file being read that a shrink leaves
+   alone, so that readahead is not thrown away before it is used
+*/
+#define CURSE_CACHEQUOTA_SPARE 256
+
+static int curse_quota_active(struct curse_state *cs) {
+    return test_bit(CURSE_CACHEQUOTA, &cs->curses) && curse_global_status(CURSE_CACHEQUOTA);
+}
+
+/* the inode id names, pinned, if it is still in the inode cache; its
+   super block is held in *sb against umount until the caller is done
+   and calls iput() and drop_super(). An inode that has left the cache
+   has no pages left either.
+*/
+static struct inode *curse_inode_get(const struct curse_inode_id *id, struct super_block **sb) {
+    struct inode *inode;
+
+    *sb = user_get_super(id->dev);
+    if (*sb == NULL) {
+        return NULL;
+    }
+    inode = ilookup(*sb, id->ino);
+    if (inode != NULL && inode->i_generation != id->generation) {
+        iput(inode);
+        inode = NULL;
+    }
+    if (inode == NULL) {
+        drop_super(*sb);
+    }
+    return inode;
+}
+
+/* called under lock */
+static struct curse_quota_file *curse_cachequota_find(struct curse_state *cs, const struct curse_inode_id *id) {
+    struct curse_quota_file *qf;
+
+    list_for_each_entry(qf, &cs->cachequota_files, lru) {
+        if (curse_inode_id_eq(&qf->id, id)) {
+            return qf;
+        }
+    }
+    return NULL;
+}
+
+/* called under lock */
+static void curse_cachequota_forget(struct curse_state *cs, struct curse_quota_file *qf) {
+    list_del(&qf->lru);
+    --cs->cachequota_nr_files;
+    cs->cachequota_charged -= min(qf->pages, cs->cachequota_charged);
+    kmem_cache_free(curse_quota_cachep, qf);
+}
+
+/* reclaim, truncation and nocache take pages the task was charged for,
+   and the task may read them in and be charged again. Before anything
+   is evicted, every charge is capped to what its file has left in the
+   page cache, and the files with nothing left are forgotten.
+*/
+static void curse_cachequota_recount(struct curse_state *cs) {
+    struct curse_inode_id ids[CURSE_CACHEQUOTA_FILES_MAX];
+    struct curse_quota_file *qf;
+    struct super_block *sb;
+    struct inode *inode;
+    unsigned long resident;
+    unsigned int i, nr = 0;
+
+    spin_lock(&cs->lock);
+    list_for_each_entry(qf, &cs->cachequota_files, lru) {
+        ids[nr++] = qf->id;
+    }
+    spin_unlock(&cs->lock);
+
+    for (i = 0; i < nr; ++i) {
+        resident = 0;
+        inode = curse_inode_get(&ids[i], &sb);
+        if (inode != NULL) {
+            resident = inode->i_mapping->nrpages;
+            iput(inode);
+            drop_super(sb);
+        }
+
+        spin_lock(&cs->lock);
+        qf = curse_cachequota_find(cs, &ids[i]);
+        if (qf != NULL && resident == 0) {
+            curse_cachequota_forget(cs, qf);
+        }
+        else if (qf != NULL && qf->pages > resident) {
+            cs->cachequota_charged -= min(qf->pages - resident, cs->cachequota_charged);
+            qf->pages = resident;
+        }
+        spin_unlock(&cs->lock);
+    }
+}
+
+/* evict the coldest files until the task is below its target again,
+   sparing the front of the file it charged last. When the LRU was
+   full, at least one file goes to make room.
+*/
+static void curse_cachequota_work(struct work_struct *work) {
+    struct curse_state *cs = container_of(work, struct curse_state, cachequota_work);
+    unsigned long quota = cs->params.cachequota_pages;
+    unsigned long target = quota - quota / 8;
+    unsigned long uncharge;
+    struct curse_quota_file *qf;
+    struct curse_inode_id id;
+    struct super_block *sb;
+    struct inode *inode;
+    pgoff_t start, end;
+    unsigned int scanned;
+    int force;
+
+    ++cs->cachequota_shrinks;
+    curse_cachequota_recount(cs);
+    for (;;) {
+        spin_lock(&cs->lock);
+        force = cs->cachequota_force;
+        cs->cachequota_force = 0;
+        if (list_empty(&cs->cachequota_files) || (!force && cs->cachequota_charged <= target)) {
+            spin_unlock(&cs->lock);
+            break;
+        }
+
+        /* second chance for the files read again since the last shrink */
+        for (scanned = 0; scanned < cs->cachequota_nr_files; ++scanned) {
+            qf = list_entry(cs->cachequota_files.prev, struct curse_quota_file, lru);
+            if (!qf->referenced) {
+                break;
             }
-            // printk(KERN_INFO "curse_nocache_checkpoint invalidating data from RAM\n");
+            qf->referenced = 0;
+            list_move(&qf->lru, &cs->cachequota_files);
+        }
+        qf = list_entry(cs->cachequota_files.prev, struct curse_quota_file, lru);
+        id = qf->id;
+        start = qf->start;
+        end = qf->end;
+
+        if (curse_inode_id_eq(&id, &cs->cachequota_current)) {
+            if (end - start < CURSE_CACHEQUOTA_SPARE) {
+                /* nothing left but what is being read */
+                spin_unlock(&cs->lock);
+                break;
+            }
+            /* keep the front of the stream, at the head of the LRU */
+            end -= CURSE_CACHEQUOTA_SPARE;
+            qf->start = end + 1;
+            uncharge = qf->pages - min_t(unsigned long, qf->pages, CURSE_CACHEQUOTA_SPARE);
+            qf->pages -= uncharge;
+            cs->cachequota_charged -= min(uncharge, cs->cachequota_charged);
+            list_move(&qf->lru, &cs->cachequota_files);
         }
         else {
-            write_unlock_irq(&tasklist_lock);
+            curse_cachequota_forget(cs, qf);
+        }
+        spin_unlock(&cs->lock);
+
+        inode = curse_inode_get(&id, &sb);
+        if (inode != NULL) {
+            cs->cachequota_evicted += invalidate_mapping_pages(inode->i_mapping, start, end);
+            iput(inode);
+            drop_super(sb);
         }
     }
 }
+
+static void curse_cachequota_charge(struct curse_state *cs, struct page *page) {
+    struct address_space *mapping = page->mapping;
+    struct curse_quota_file *qf;
+    struct curse_inode_id id;
+    int over = 0;
+
+    /* the quota is on cache; tmpfs and shmem pages cannot be evicted,
+       only swapped, and charging them would make the task evict its
+       real cache to make room for them
+    */
+    if (PageSwapBacked(page)) {
+        return;
+    }
+    curse_inode_id_set(&id, mapping->host);
+
+    spin_lock(&cs->lock);
+    cs->cachequota_current = id;
+    qf = curse_cachequota_find(cs, &id);
+    if (qf == NULL) {
+        if (cs->cachequota_nr_files == CURSE_CACHEQUOTA_FILES_MAX) {
+            cs->cachequota_force = over = 1;
+            goto out;
+        }
+        /* add_to_page_cache_lru() may have been called with GFP_NOFS */
+        qf = kmem_cache_alloc(curse_quota_cachep, GFP_NOWAIT | __GFP_NOWARN);
+        if (qf == NULL) {
+            goto out;
+        }
+        qf->id = id;
+        qf->start = qf->end = page->index;
+        qf->pages = 0;
+        qf->referenced = 0;
+        list_add(&qf->lru, &cs->cachequota_files);
+        ++cs->cachequota_nr_files;
+    }
+    else {
+        list_move(&qf->lru, &cs->cachequota_files);
+    }
+    qf->start = min(qf->start, page->index);
+    qf->end = max(qf->end, page->index);
+    /* a page read in again after reclaim took it is not charged twice */
+    if (qf->pages < mapping->nrpages) {
+        ++qf->pages;
+        ++cs->cachequota_charged;
+    }
+    over = cs->cachequota_charged > cs->params.cachequota_pages;
+out:
+    spin_unlock(&cs->lock);
+
+    if (over) {
+        queue_work(curse_wq, &cs->cachequota_work);
+    }
+}
+
+/* a stream reads each of its pages once; only a page that is read
+   again, i.e. already referenced, marks its file as part of the hot set.
+   mark_page_accessed() also sees anonymous and swap cache pages, which
+   belong to no file
+*/
+static void curse_cachequota_accessed(struct curse_state *cs, struct page *page) {
+    struct address_space *mapping;
+    struct curse_quota_file *qf;
+    struct curse_inode_id id;
+
+    if (PageAnon(page) || !PageReferenced(page)) {
+        return;
+    }
+    mapping = page_mapping(page);
+    if (mapping == NULL || mapping->host == NULL) {
+        return;
+    }
+    curse_inode_id_set(&id, mapping->host);
+
+    spin_lock(&cs->lock);
+    qf = curse_cachequota_find(cs, &id);
+    if (qf != NULL) {
+        qf->referenced = 1;
+        list_move(&qf->lru, &cs->cachequota_files);
+    }
+    spin_unlock(&cs->lock);
+}
+
+/* forget the charged files without evicting anything */
+static void curse_cachequota_release(struct curse_state *cs) {
+    LIST_HEAD(files);
+    struct curse_quota_file *qf, *next;
+
+    spin_lock(&cs->lock);
+    list_splice_init(&cs->cachequota_files, &files);
+    cs->cachequota_nr_files = 0;
+    cs->cachequota_charged = 0;
+    spin_unlock(&cs->lock);
+
+    list_for_each_entry_safe(qf, next, &files, lru) {
+        kmem_cache_free(curse_quota_cachep, qf);
+    }
+}
+
+static long curse_cachequota_disable(struct task_struct *target) {
+    curse_cachequota_release(target->curse);
+    return 0;
+}
+
+
+/* ******************************* */
+/*  THROTTLE Curse Implementation  */
+/* ******************************* */
+
+/* A throttled task may move params.throttle_bps bytes and make
+   params.throttle_iops reads and writes a second, 0 meaning no limit.
+   Each limit is a token bucket kept as time credit: the credit grows
+   with the time that passes, up to a second's worth, and every read
+   or write is charged the time it takes at the allowed rate, after
+   the fact. A task that has run either bucket into debt sleeps until
+   the debt is paid off, so a large request goes through at once and
+   the task pays for it afterwards. The limits are read at every call
+   and casting the curse again with other parameters changes them on
+   the fly.
+   Pipes and sockets are not throttled, only files and block devices.
+   Nor is I/O the kernel does on the task's behalf through
+   kernel_read() and set_fs(KERNEL_DS): exec reads the binary that
+   way with cred_guard_mutex held, and must not sleep off a debt with
+   it.
+*/
+
+static int curse_throttled(struct curse_state *cs) {
+    return cs != NULL && test_bit(CURSE_THROTTLE, &cs->curses) && curse_global_status(CURSE_THROTTLE);
+}
+
+/* top up a bucket with elapsed ns, at most to a second's worth, and
+   charge it cost ns; a debt of any size is repaid by the time that passes
+   while it is slept off, and the comparison keeps a long idle time from
+   overflowing the credit
+*/
+static void curse_throttle_charge(s64 *credit, u64 elapsed, u64 cost) {
+    if (elapsed >= (u64)(NSEC_PER_SEC - *credit)) {
+        *credit = NSEC_PER_SEC;
+    }
+    else {
+        *credit += elapsed;
+    }
+    *credit -= cost;
+}
+
+void __curse_throttle_checkpoint(struct file *file, ssize_t amount) {
+    struct curse_state *cs = current->curse;
+    u32 bps, iops;
+    ktime_t now;
+    u64 elapsed;
+    s64 debt = 0;
+
+    if (amount < 0 || !curse_throttled(cs) || !curse_file_cacheable(file)) {
+        return;
+    }
+    if (segment_eq(get_fs(), KERNEL_DS)) {
+        return;
+    }
+    bps = cs->params.throttle_bps;
+    iops = cs->params.throttle_iops;
+
+    now = ktime_get();
+    elapsed = ktime_to_ns(ktime_sub(now, cs->throttle_stamp));
+    cs->throttle_stamp = now;
+
+    if (bps != 0) {
+        curse_throttle_charge(&cs->throttle_bytes_credit, elapsed, div_u64((u64)amount * NSEC_PER_SEC, bps));
+        debt = max(debt, -cs->throttle_bytes_credit);
+    }
+    if (iops != 0) {
+        curse_throttle_charge(&cs->throttle_ops_credit, elapsed, NSEC_PER_SEC / iops);
+        debt = max(debt, -cs->throttle_ops_credit);
+    }
+    if (debt <= 0) {
+        return;
+    }
+
+    ++cs->throttle_waits;
+    /* the time slept is credited at the next call; a fatal signal cuts
+       the sleep short and the task never comes back
+    */
+    schedule_timeout_killable(msecs_to_jiffies(div_u64(debt + NSEC_PER_MSEC - 1, NSEC_PER_MSEC)));
+}
+EXPORT_SYMBOL(__curse_throttle_checkpoint);
+
+
+/* ************************** */
+/*      Page Cache Hooks      */
+/* ************************** */
+
+void __curse_page_cache_add(struct page *page) {
+    struct curse_state *cs = current->curse;
+
+    if (cs == NULL) {
+        return;
+    }
+    if (curse_stinks(cs)) {
+        curse_stink_page_cache_add(cs, page);
+    }
+    if (curse_nocache_owns(cs)) {
+        curse_nocache_own(cs, page);
+    }
+    if (curse_quota_active(cs)) {
+        curse_cachequota_charge(cs, page);
+    }
+}
+EXPORT_SYMBOL(__curse_page_cache_add);
+
+int __curse_page_accessed(struct page *page) {
+    struct curse_state *cs = current->curse;
+
+    if (cs == NULL) {
+        return 0;
+    }
+    if (curse_quota_active(cs)) {
+        curse_cachequota_accessed(cs, page);
+    }
+    return curse_stinks(cs) || (curse_nocache_owns(cs) && curse_nocache_streams_through(cs, page));
+}
+EXPORT_SYMBOL(__curse_page_accessed);